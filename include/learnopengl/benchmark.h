@@ -0,0 +1,247 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// scripted camera flight: keyframes of position and yaw/pitch (degrees), linearly interpolated. text file, one
+// `key <time> <x> <y> <z> <yaw> <pitch>` per line, times increasing, '#' starts a comment.
+// see resources/bench/flyby.path
+class CameraPath
+{
+public:
+    struct Key {
+        float time;
+        glm::vec3 position;
+        float yaw, pitch;
+    };
+
+    bool LoadFromFile(const std::string &filename)
+    {
+        std::ifstream in(filename);
+        if (!in)
+        {
+            std::cout << "ERROR::CAMERA_PATH:: cannot open " << filename << std::endl;
+            return false;
+        }
+        keys.clear();
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            lineNumber++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+            std::istringstream words(line);
+            std::string keyword;
+            if (!(words >> keyword))
+                continue;
+            Key key;
+            if (keyword != "key" || !(words >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch) ||
+                (!keys.empty() && key.time <= keys.back().time))
+            {
+                std::cout << "ERROR::CAMERA_PATH:: " << filename << ":" << lineNumber << ": " << line << std::endl;
+                return false;
+            }
+            keys.push_back(key);
+        }
+        if (keys.empty())
+            std::cout << "ERROR::CAMERA_PATH:: " << filename << " has no keys" << std::endl;
+        return !keys.empty();
+    }
+
+    float Duration() const
+    {
+        return keys.empty() ? 0.0f : keys.back().time;
+    }
+
+    // pose at `time`, clamped to the first and last key
+    Key Sample(float time) const
+    {
+        if (time <= keys.front().time)
+            return keys.front();
+        if (time >= keys.back().time)
+            return keys.back();
+        size_t next = 1;
+        while (keys[next].time < time)
+            next++;
+        const Key &a = keys[next - 1], &b = keys[next];
+        float t = (time - a.time) / (b.time - a.time);
+        Key key;
+        key.time = time;
+        key.position = glm::mix(a.position, b.position, t);
+        key.yaw = a.yaw + (b.yaw - a.yaw) * t;
+        key.pitch = a.pitch + (b.pitch - a.pitch) * t;
+        return key;
+    }
+
+private:
+    std::vector<Key> keys;
+};
+
+// GPU time of each frame from GL_TIME_ELAPSED queries. results are read a few frames late so waiting on them never
+// stalls the pipeline.
+class GpuFrameTimer
+{
+public:
+    GpuFrameTimer()
+    {
+        glGenQueries(LATENCY, queries);
+    }
+
+    ~GpuFrameTimer()
+    {
+        glDeleteQueries(LATENCY, queries);
+    }
+
+    GpuFrameTimer(const GpuFrameTimer&) = delete;
+    GpuFrameTimer& operator=(const GpuFrameTimer&) = delete;
+
+    void Begin(int frame)
+    {
+        int slot = frame % LATENCY;
+        if (frames[slot] >= 0)
+            collect(slot);
+        frames[slot] = frame;
+        glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+    }
+
+    void End()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    // reads every outstanding query, call once after the last frame
+    void Finish()
+    {
+        for (int slot = 0; slot < LATENCY; slot++)
+        {
+            if (frames[slot] >= 0)
+                collect(slot);
+        }
+    }
+
+    // (frame, milliseconds) pairs collected so far, in no particular order
+    const std::vector<std::pair<int, double>> &Results() const
+    {
+        return results;
+    }
+
+private:
+    static const int LATENCY = 4;
+    unsigned int queries[LATENCY];
+    int frames[LATENCY] = {-1, -1, -1, -1};
+    std::vector<std::pair<int, double>> results;
+
+    void collect(int slot)
+    {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &nanoseconds);
+        results.push_back(std::make_pair(frames[slot], nanoseconds / 1.0e6));
+        frames[slot] = -1;
+    }
+};
+
+// per-frame timings of a benchmark run and their summary as JSON
+class FrameStats
+{
+public:
+    // histogram buckets are BUCKET_MS wide, the last one also counts everything slower
+    static constexpr double BUCKET_MS = 1.0;
+    static const int BUCKETS = 50;
+
+    void Add(double cpuMs, double frameMs)
+    {
+        cpu.push_back(cpuMs);
+        frame.push_back(frameMs);
+    }
+
+    void AddGpu(double gpuMs)
+    {
+        gpu.push_back(gpuMs);
+    }
+
+    // `info` is written as string fields next to the statistics (scene, renderer, resolution...)
+    bool WriteJson(const std::string &filename, const std::vector<std::pair<std::string, std::string>> &info) const
+    {
+        std::ofstream out(filename);
+        if (!out)
+        {
+            std::cout << "ERROR::BENCHMARK:: cannot write " << filename << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(3) << "{\n";
+        for (const auto &field : info)
+            out << "  \"" << field.first << "\": \"" << escape(field.second) << "\",\n";
+        out << "  \"frames\": " << frame.size() << ",\n";
+        writeSeries(out, "frame_ms", frame);
+        out << ",\n";
+        writeSeries(out, "cpu_ms", cpu);
+        out << ",\n";
+        writeSeries(out, "gpu_ms", gpu);
+        out << "\n}\n";
+        return true;
+    }
+
+private:
+    std::vector<double> cpu, gpu, frame;
+
+    static void writeSeries(std::ostream &out, const char* name, std::vector<double> values)
+    {
+        out << "  \"" << name << "\": {";
+        if (values.empty())
+        {
+            out << "}";
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+        out << "\"min\": " << values.front()
+            << ", \"median\": " << percentile(values, 0.5)
+            << ", \"p95\": " << percentile(values, 0.95)
+            << ", \"p99\": " << percentile(values, 0.99)
+            << ", \"max\": " << values.back()
+            << ", \"mean\": " << sum / values.size()
+            << ", \"histogram_bucket_ms\": " << BUCKET_MS
+            << ", \"histogram\": [";
+        std::vector<int> histogram(BUCKETS, 0);
+        for (double value : values)
+            histogram[std::min(BUCKETS - 1, (int) (value / BUCKET_MS))]++;
+        for (int i = 0; i < BUCKETS; i++)
+            out << (i ? ", " : "") << histogram[i];
+        out << "]}";
+    }
+
+    // nearest-rank percentile of sorted values
+    static double percentile(const std::vector<double> &sorted, double p)
+    {
+        size_t rank = (size_t) std::ceil(p * sorted.size());
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+#endif
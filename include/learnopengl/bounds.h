@@ -0,0 +1,64 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// bounding sphere in the space of the vertices it was built from. radius < 0 marks an empty sphere.
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f;
+
+    bool Empty() const
+    {
+        return radius < 0.0f;
+    }
+
+    // sphere around the axis aligned box of the points, grown to reach the farthest point. not minimal, but one pass
+    // over the positions and within a few percent of it for the round meshes we load.
+    template<typename Vertex>
+    static BoundingSphere FromVertices(const std::vector<Vertex> &vertices)
+    {
+        BoundingSphere sphere;
+        if (vertices.empty())
+            return sphere;
+        glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+        for (const Vertex &vertex : vertices)
+        {
+            low = glm::min(low, vertex.Position);
+            high = glm::max(high, vertex.Position);
+        }
+        sphere.center = (low + high) * 0.5f;
+        float radius2 = 0.0f;
+        for (const Vertex &vertex : vertices)
+        {
+            glm::vec3 offset = vertex.Position - sphere.center;
+            radius2 = std::max(radius2, glm::dot(offset, offset));
+        }
+        sphere.radius = std::sqrt(radius2);
+        return sphere;
+    }
+
+    // smallest sphere containing both
+    static BoundingSphere Merge(const BoundingSphere &a, const BoundingSphere &b)
+    {
+        if (a.Empty())
+            return b;
+        if (b.Empty())
+            return a;
+        glm::vec3 offset = b.center - a.center;
+        float distance = glm::length(offset);
+        if (distance + b.radius <= a.radius)
+            return a;
+        if (distance + a.radius <= b.radius)
+            return b;
+        BoundingSphere merged;
+        merged.radius = (distance + a.radius + b.radius) * 0.5f;
+        merged.center = a.center + offset * ((merged.radius - a.radius) / distance);
+        return merged;
+    }
+};
+#endif
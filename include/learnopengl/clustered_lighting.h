@@ -0,0 +1,323 @@
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLUSTERED_LIGHTING_SSE 1
+#endif
+
+// one point light as model_lighting.fs reads it: four RGBA32F texels of the light buffer. the usual constant / linear /
+// quadratic attenuation is multiplied by a window that reaches zero at `range`, so a light can be skipped outside it.
+struct PointLightData {
+    glm::vec4 positionRange;    // xyz world position, w range
+    glm::vec4 diffuseConstant;  // rgb diffuse, w constant attenuation
+    glm::vec4 specularLinear;   // rgb specular, w linear attenuation
+    glm::vec4 ambientQuadratic; // rgb ambient, w quadratic attenuation
+};
+
+// appends the `ids` of the spheres among the first `count` that touch the box [boxMin, boxMax] to `out`. four spheres
+// per iteration with SSE; the remainder, or everything without SSE, takes the scalar path.
+inline void SpheresInBox(const float* x, const float* y, const float* z, const float* radius, const uint32_t* ids,
+                         size_t count, const glm::vec3 &boxMin, const glm::vec3 &boxMax, std::vector<uint32_t> &out)
+{
+    size_t i = 0;
+#ifdef CLUSTERED_LIGHTING_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 minX = _mm_set1_ps(boxMin.x), minY = _mm_set1_ps(boxMin.y), minZ = _mm_set1_ps(boxMin.z);
+    const __m128 maxX = _mm_set1_ps(boxMax.x), maxY = _mm_set1_ps(boxMax.y), maxZ = _mm_set1_ps(boxMax.z);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sphereX = _mm_loadu_ps(x + i), sphereY = _mm_loadu_ps(y + i), sphereZ = _mm_loadu_ps(z + i);
+        __m128 r = _mm_loadu_ps(radius + i);
+        // distance from the center to the box along each axis, zero inside
+        __m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minX, sphereX), _mm_sub_ps(sphereX, maxX)));
+        __m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minY, sphereY), _mm_sub_ps(sphereY, maxY)));
+        __m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(minZ, sphereZ), _mm_sub_ps(sphereZ, maxZ)));
+        __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_mul_ps(r, r)));
+        for (int lane = 0; mask; lane++, mask >>= 1)
+        {
+            if (mask & 1)
+                out.push_back(ids[i + lane]);
+        }
+    }
+#endif
+    for (; i < count; i++)
+    {
+        float dx = std::max(0.0f, std::max(boxMin.x - x[i], x[i] - boxMax.x));
+        float dy = std::max(0.0f, std::max(boxMin.y - y[i], y[i] - boxMax.y));
+        float dz = std::max(0.0f, std::max(boxMin.z - z[i], z[i] - boxMax.z));
+        if (dx * dx + dy * dy + dz * dz <= radius[i] * radius[i])
+            out.push_back(ids[i]);
+    }
+}
+
+// clustered forward lighting: the view frustum is cut into TILES_X * TILES_Y screen tiles and SLICES exponential depth
+// slices. every frame the lights are assigned to the clusters their range touches, one slice per thread pool job, and
+// model_lighting.fs only evaluates the lights of its fragment's cluster. the lights, the (first, count) range of every
+// cluster and the concatenated light index lists go to the shaders as buffer textures on units LIGHT_UNIT and up.
+// every frame: Update, Fill the FrameData, Bind in each pass that lights.
+class ClusteredLighting
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    // units 0 and 1 hold the material textures
+    static const unsigned int LIGHT_UNIT = 2;
+
+    ClusteredLighting()
+    {
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for (int i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            GLStateCache::Instance().BindTexture(LIGHT_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    ~ClusteredLighting()
+    {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+
+    ClusteredLighting(const ClusteredLighting&) = delete;
+    ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+    // distance at which constant / linear / quadratic attenuation falls to `threshold`
+    static float AttenuationRange(float constant, float linear, float quadratic, float threshold = 1.0f / 256.0f)
+    {
+        float target = 1.0f / threshold - constant;
+        if (target <= 0.0f)
+            return 0.0f;
+        if (quadratic <= 0.0f)
+            return linear > 0.0f ? target / linear : 1e30f;
+        return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * target)) / (2.0f * quadratic);
+    }
+
+    // assigns `lights` to the clusters of the frustum given by `view` and the perspective parameters, then uploads them
+    void Update(const std::vector<PointLightData> &lights, const glm::mat4 &view, float fovy, float aspect,
+                float nearPlane, float farPlane)
+    {
+        if (fovy != clusterFovy || aspect != clusterAspect || nearPlane != clusterNear || farPlane != clusterFar)
+            buildClusterBounds(fovy, aspect, nearPlane, farPlane);
+        lightCount = lights.size();
+
+        // view space spheres with depth along +z, lights entirely behind the near or past the far plane dropped
+        x.clear();
+        y.clear();
+        depth.clear();
+        radius.clear();
+        ids.clear();
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].positionRange), 1.0f));
+            float range = lights[i].positionRange.w;
+            if (-center.z + range < nearPlane || -center.z - range > farPlane)
+                continue;
+            x.push_back(center.x);
+            y.push_back(center.y);
+            depth.push_back(-center.z);
+            radius.push_back(range);
+            ids.push_back((uint32_t) i);
+        }
+
+        ThreadPool::Instance().ParallelFor(SLICES, [this](size_t slice) {
+            assignSlice((int) slice);
+        });
+
+        // concatenate the per slice lists, slices own consecutive clusters
+        indices.clear();
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            uint32_t base = (uint32_t) indices.size();
+            for (int c = slice * TILES_X * TILES_Y; c < (slice + 1) * TILES_X * TILES_Y; c++)
+                clusters[c * 2] += base;
+            indices.insert(indices.end(), sliceIndices[slice].begin(), sliceIndices[slice].end());
+        }
+        maxLightsPerCluster = 0;
+        for (int c = 0; c < CLUSTER_COUNT; c++)
+            maxLightsPerCluster = std::max(maxLightsPerCluster, clusters[c * 2 + 1]);
+
+        upload(0, lights.data(), lights.size() * sizeof(PointLightData));
+        upload(1, clusters.data(), clusters.size() * sizeof(uint32_t));
+        upload(2, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+
+    // cluster lookup parameters for the shaders, `width` x `height` being the viewport size
+    void Fill(FrameData &frameData, int width, int height) const
+    {
+        // slice = log(depth) * scale + bias puts the near plane at 0 and the far plane at SLICES
+        float sliceScale = SLICES / std::log(clusterFar / clusterNear);
+        frameData.clusterScale = glm::vec4((float) TILES_X / width, (float) TILES_Y / height, sliceScale,
+                                           -std::log(clusterNear) * sliceScale);
+        frameData.clusterCount = glm::vec4(TILES_X, TILES_Y, SLICES, (float) lightCount);
+    }
+
+    // binds the light buffers and points the shader's samplers at them
+    void Bind(Shader &shader)
+    {
+        if (uniformShaderID != shader.ID)
+        {
+            uniformShaderID = shader.ID;
+            samplerUniforms[0] = shader.GetUniform("lights");
+            samplerUniforms[1] = shader.GetUniform("lightClusters");
+            samplerUniforms[2] = shader.GetUniform("lightIndices");
+        }
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            GLStateCache::Instance().BindTexture(LIGHT_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+            shader.setInt(samplerUniforms[i], (int) (LIGHT_UNIT + i));
+        }
+    }
+
+    size_t LightCount() const
+    {
+        return lightCount;
+    }
+
+    // light indices stored for all clusters and the most lights any cluster has, a measure of the shading cost
+    size_t AssignedCount() const
+    {
+        return indices.size();
+    }
+
+    unsigned int MaxLightsPerCluster() const
+    {
+        return maxLightsPerCluster;
+    }
+
+private:
+    unsigned int buffers[3], textures[3];
+    UniformHandle samplerUniforms[3];
+    unsigned int uniformShaderID = 0;
+
+    float clusterFovy = 0.0f, clusterAspect = 0.0f, clusterNear = 0.0f, clusterFar = 0.0f;
+    // view space bounds of every cluster with depth along +z, index (slice * TILES_Y + y) * TILES_X + x
+    std::vector<glm::vec3> boundsMin, boundsMax;
+
+    // visible lights of the current frame as view space spheres
+    std::vector<float> x, y, depth, radius;
+    std::vector<uint32_t> ids;
+    size_t lightCount = 0;
+
+    // (first, count) per cluster, the first relative to its slice's list until Update concatenates them
+    std::vector<uint32_t> clusters = std::vector<uint32_t>(CLUSTER_COUNT * 2);
+    std::vector<uint32_t> sliceIndices[SLICES];
+    // per slice scratch, the lights overlapping the slice's depth range
+    std::vector<float> sliceX[SLICES], sliceY[SLICES], sliceDepth[SLICES], sliceRadius[SLICES];
+    std::vector<uint32_t> sliceIds[SLICES];
+    std::vector<uint32_t> indices;
+    unsigned int maxLightsPerCluster = 0;
+
+    // every cluster's box around the eight corners of its tile at the slice's near and far depth
+    void buildClusterBounds(float fovy, float aspect, float nearPlane, float farPlane)
+    {
+        clusterFovy = fovy;
+        clusterAspect = aspect;
+        clusterNear = nearPlane;
+        clusterFar = farPlane;
+        boundsMin.resize(CLUSTER_COUNT);
+        boundsMax.resize(CLUSTER_COUNT);
+        float tanY = std::tan(fovy * 0.5f), tanX = tanY * aspect;
+        for (int slice = 0; slice < SLICES; slice++)
+        {
+            float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float) slice / SLICES);
+            float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float) (slice + 1) / SLICES);
+            for (int tileY = 0; tileY < TILES_Y; tileY++)
+            {
+                for (int tileX = 0; tileX < TILES_X; tileX++)
+                {
+                    // tile edges in normalized device coordinates
+                    float left = -1.0f + 2.0f * tileX / TILES_X, right = -1.0f + 2.0f * (tileX + 1) / TILES_X;
+                    float bottom = -1.0f + 2.0f * tileY / TILES_Y, top = -1.0f + 2.0f * (tileY + 1) / TILES_Y;
+                    glm::vec3 low(1e30f), high(-1e30f);
+                    for (float d : {sliceNear, sliceFar})
+                    {
+                        for (float ndcX : {left, right})
+                        {
+                            for (float ndcY : {bottom, top})
+                            {
+                                glm::vec3 corner(ndcX * tanX * d, ndcY * tanY * d, d);
+                                low = glm::min(low, corner);
+                                high = glm::max(high, corner);
+                            }
+                        }
+                    }
+                    int c = (slice * TILES_Y + tileY) * TILES_X + tileX;
+                    boundsMin[c] = low;
+                    boundsMax[c] = high;
+                }
+            }
+        }
+    }
+
+    // runs on the thread pool: tests the lights overlapping the slice's depth range against each of its tiles
+    void assignSlice(int slice)
+    {
+        int first = slice * TILES_X * TILES_Y;
+        float sliceNear = boundsMin[first].z, sliceFar = boundsMax[first].z;
+        std::vector<float> &sx = sliceX[slice], &sy = sliceY[slice], &sz = sliceDepth[slice], &sr = sliceRadius[slice];
+        std::vector<uint32_t> &sids = sliceIds[slice];
+        sx.clear();
+        sy.clear();
+        sz.clear();
+        sr.clear();
+        sids.clear();
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            if (depth[i] + radius[i] < sliceNear || depth[i] - radius[i] > sliceFar)
+                continue;
+            sx.push_back(x[i]);
+            sy.push_back(y[i]);
+            sz.push_back(depth[i]);
+            sr.push_back(radius[i]);
+            sids.push_back(ids[i]);
+        }
+
+        std::vector<uint32_t> &out = sliceIndices[slice];
+        out.clear();
+        for (int c = first; c < first + TILES_X * TILES_Y; c++)
+        {
+            size_t before = out.size();
+            if (!sids.empty())
+                SpheresInBox(&sx[0], &sy[0], &sz[0], &sr[0], &sids[0], sids.size(), boundsMin[c], boundsMax[c], out);
+            clusters[c * 2] = (uint32_t) before;
+            clusters[c * 2 + 1] = (uint32_t) (out.size() - before);
+        }
+    }
+
+    // replaces the contents of buffer `i`; empty lists still get a texel so the buffer texture stays valid
+    void upload(int i, const void* data, size_t bytes)
+    {
+        static const uint32_t empty[4] = {0, 0, 0, 0};
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+        if (bytes == 0)
+            glBufferData(GL_TEXTURE_BUFFER, sizeof(empty), empty, GL_STREAM_DRAW);
+        else
+            glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,117 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+// view frustum as six planes (a, b, c, d) with normals pointing inwards: a point p is inside a plane when
+// dot(abc, p) + d >= 0.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann extraction from a projection * view matrix, so the planes are in world space
+    static Frustum FromMatrix(const glm::mat4 &m)
+    {
+        // glm is column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0;    // left
+        frustum.planes[1] = row3 - row0;    // right
+        frustum.planes[2] = row3 + row1;    // bottom
+        frustum.planes[3] = row3 - row1;    // top
+        frustum.planes[4] = row3 + row2;    // near
+        frustum.planes[5] = row3 - row2;    // far
+        for (glm::vec4 &plane : frustum.planes)
+            plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+        return frustum;
+    }
+
+    bool IntersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// tests `count` spheres given as separate x/y/z/radius arrays and writes 1 (possibly visible) or 0 (certainly outside)
+// into `visible`. four spheres per iteration with SSE; the remainder, or everything without SSE, takes the scalar path.
+inline void CullSpheres(const Frustum &frustum, const float* x, const float* y, const float* z, const float* radius,
+                        size_t count, unsigned char* visible)
+{
+    size_t i = 0;
+#ifdef CULLING_SSE
+    __m128 planeA[6], planeB[6], planeC[6], planeD[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planeA[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeB[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeC[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeD[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 sphereX = _mm_loadu_ps(x + i), sphereY = _mm_loadu_ps(y + i), sphereZ = _mm_loadu_ps(z + i);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(radius + i));
+        // all lanes start inside; each plane clears the lanes whose sphere lies completely behind it
+        __m128 inside = _mm_cmpeq_ps(zero, zero);
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeA[p], sphereX), _mm_mul_ps(planeB[p], sphereY)),
+                                         _mm_add_ps(_mm_mul_ps(planeC[p], sphereZ), planeD[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        int mask = _mm_movemask_ps(inside);
+        visible[i] = (unsigned char) (mask & 1);
+        visible[i + 1] = (unsigned char) ((mask >> 1) & 1);
+        visible[i + 2] = (unsigned char) ((mask >> 2) & 1);
+        visible[i + 3] = (unsigned char) ((mask >> 3) & 1);
+    }
+#endif
+    for (; i < count; i++)
+        visible[i] = frustum.IntersectsSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+}
+
+// world space spheres stored as separate arrays for CullSpheres, with the result per sphere
+struct SphereSet {
+    std::vector<float> x, y, z, radius;
+    std::vector<unsigned char> visible;
+
+    void Resize(size_t count)
+    {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        radius.resize(count);
+        visible.resize(count, 1);
+    }
+
+    void Set(size_t i, const glm::vec3 &center, float sphereRadius)
+    {
+        x[i] = center.x;
+        y[i] = center.y;
+        z[i] = center.z;
+        radius[i] = sphereRadius;
+    }
+
+    void Cull(const Frustum &frustum)
+    {
+        if (!x.empty())
+            CullSpheres(frustum, &x[0], &y[0], &z[0], &radius[0], x.size(), &visible[0]);
+    }
+};
+#endif
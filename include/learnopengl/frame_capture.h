@@ -0,0 +1,89 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// framebuffer with colour and depth renderbuffers. headless runs render into it instead of the (invisible) window.
+class OffscreenTarget
+{
+public:
+    unsigned int FBO = 0;
+    int width, height;
+
+    OffscreenTarget(int width, int height) : width(width), height(height)
+    {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: offscreen framebuffer is not complete" << std::endl;
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~OffscreenTarget()
+    {
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteFramebuffers(1, &FBO);
+    }
+
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+    // draw and read from this target with a matching viewport
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glViewport(0, 0, width, height);
+    }
+
+private:
+    unsigned int colorRBO = 0, depthRBO = 0;
+};
+
+namespace FrameCapture {
+
+    // writes the colour of the bound read framebuffer as a binary PPM. GL rows start at the bottom, so they are written
+    // in reverse to get an upright image.
+    inline bool SavePPM(const std::string &filename, int width, int height)
+    {
+        std::vector<unsigned char> pixels((size_t) width * height * 3);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::FRAME_CAPTURE:: cannot write " << filename << std::endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        for (int row = height - 1; row >= 0; row--)
+            fwrite(&pixels[(size_t) row * width * 3], 1, (size_t) width * 3, file);
+        fclose(file);
+        return true;
+    }
+
+    // <directory>/frame_00042.ppm
+    inline std::string FileName(const std::string &directory, int frame)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+        return directory + "/" + name;
+    }
+}
+#endif
@@ -0,0 +1,52 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// CPU mirror of the std140 `FrameData` uniform block declared in resources/shaders. member order and padding must match
+// the GLSL declaration exactly: every vec3 is stored in a vec4.
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPosition;     // xyz
+    glm::vec4 clusterScale;     // xy = light clusters per pixel, slice = log(view depth) * z + w
+    glm::vec4 clusterCount;     // x, y = screen tiles, z = depth slices, w = lights; see ClusteredLighting
+    float time;
+    float padding[3];
+};
+
+// binding point of FrameData; Shader binds the block of every program to it after linking
+const GLuint FRAME_DATA_BINDING = 0;
+
+// per-frame camera and light cluster state shared by all programs through one uniform buffer, uploaded once per frame
+class FrameUniforms
+{
+public:
+    unsigned int UBO;
+
+    FrameUniforms()
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, UBO);
+    }
+
+    ~FrameUniforms()
+    {
+        glDeleteBuffers(1, &UBO);
+    }
+
+    FrameUniforms(const FrameUniforms&) = delete;
+    FrameUniforms& operator=(const FrameUniforms&) = delete;
+
+    void Update(const FrameData &data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+#endif
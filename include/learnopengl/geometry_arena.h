@@ -0,0 +1,242 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/vertex_layout.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// first-fit sub-allocator over a range of elements. freed ranges merge with their neighbours.
+class RangeAllocator
+{
+public:
+    explicit RangeAllocator(size_t capacity = 0) : capacity(capacity)
+    {
+        if (capacity > 0)
+            freeRanges[0] = capacity;
+    }
+
+    // returns false when no free range is large enough
+    bool Allocate(size_t size, size_t &offset)
+    {
+        offset = 0;
+        if (size == 0)
+            return true;
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            if (it->second < size)
+                continue;
+            offset = it->first;
+            size_t left = it->second - size;
+            freeRanges.erase(it);
+            if (left > 0)
+                freeRanges[offset + size] = left;
+            return true;
+        }
+        return false;
+    }
+
+    void Free(size_t offset, size_t size)
+    {
+        if (size == 0)
+            return;
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    // appends free space at the end
+    void Grow(size_t newCapacity)
+    {
+        Free(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+
+private:
+    size_t capacity;
+    // offset -> size of every free range
+    std::map<size_t, size_t> freeRanges;
+};
+
+// one vertex buffer in a single layout and one index buffer of a single index type, shared by many meshes. the pool
+// VAO is created once and re-pointed when the buffers grow, so meshes can hold on to it.
+struct GeometryPool {
+    const VertexLayout* layout = nullptr;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    RangeAllocator vertices, indices;
+    // bumped whenever VBO/EBO are replaced; VAOs built elsewhere on the pool's buffers compare against it
+    unsigned int generation = 0;
+    // creation order, gives draws a stable order between pools
+    unsigned int index = 0;
+
+    size_t IndexSize() const
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+    }
+};
+
+// where one unique vertex/index stream lives in the arena. indices are relative to baseVertex, which is what lets
+// every mesh below 65536 vertices use 16 bit indices even in a pool holding far more vertices.
+struct GeometryBuffers {
+    GeometryPool* pool = nullptr;
+    unsigned int baseVertex = 0, vertexCount = 0;
+    unsigned int firstIndex = 0, indexCount = 0;
+    unsigned int refCount = 0;
+    // registry key of the streams, so a release finds its entry without a full scan
+    uint64_t contentHash = 0;
+};
+
+// global geometry arena: every mesh's vertices and indices are sub-allocated from a few large buffers, one pool per
+// vertex layout and index type, so drawing many meshes needs one VAO bind per pool instead of one per mesh.
+class GeometryArena
+{
+public:
+    // initial pool sizes in elements, doubled whenever an upload doesn't fit
+    static const size_t INITIAL_VERTICES = 1 << 16;
+    static const size_t INITIAL_INDICES = 1 << 18;
+
+    static GeometryArena &Instance()
+    {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // copies vertices already packed in `layout` and indices of `indexType` into the matching pool
+    GeometryBuffers Upload(const VertexLayout &layout, GLenum indexType, const void* vertexData, size_t vertexCount,
+                           const void* indexData, size_t indexCount)
+    {
+        GeometryPool &pool = poolFor(layout, indexType);
+        size_t baseVertex, firstIndex;
+        while (!pool.vertices.Allocate(vertexCount, baseVertex))
+            grow(pool, pool.VBO, pool.vertices, layout.stride, vertexCount);
+        while (!pool.indices.Allocate(indexCount, firstIndex))
+            grow(pool, pool.EBO, pool.indices, pool.IndexSize(), indexCount);
+
+        // the copy targets leave every VAO's bindings alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.VBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, baseVertex * layout.stride, vertexCount * layout.stride, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool.EBO);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * pool.IndexSize(), indexCount * pool.IndexSize(), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        GeometryBuffers buffers;
+        buffers.pool = &pool;
+        buffers.baseVertex = (unsigned int) baseVertex;
+        buffers.vertexCount = (unsigned int) vertexCount;
+        buffers.firstIndex = (unsigned int) firstIndex;
+        buffers.indexCount = (unsigned int) indexCount;
+        return buffers;
+    }
+
+    // returns the ranges of `buffers` to their pool
+    void Release(const GeometryBuffers &buffers)
+    {
+        buffers.pool->vertices.Free(buffers.baseVertex, buffers.vertexCount);
+        buffers.pool->indices.Free(buffers.firstIndex, buffers.indexCount);
+    }
+
+    const std::vector<GeometryPool*> &Pools() const
+    {
+        return pools;
+    }
+
+private:
+    // pools are never destroyed, meshes and renderers keep pointers to them
+    std::vector<GeometryPool*> pools;
+
+    GeometryArena() = default;
+
+    GeometryPool &poolFor(const VertexLayout &layout, GLenum indexType)
+    {
+        for (GeometryPool* pool : pools)
+        {
+            if (pool->layout == &layout && pool->indexType == indexType)
+                return *pool;
+        }
+        GeometryPool* pool = new GeometryPool;
+        pool->layout = &layout;
+        pool->indexType = indexType;
+        pool->index = (unsigned int) pools.size();
+        pool->vertices = RangeAllocator(INITIAL_VERTICES);
+        pool->indices = RangeAllocator(INITIAL_INDICES);
+        glGenVertexArrays(1, &pool->VAO);
+        pool->VBO = createBuffer(0, 0, INITIAL_VERTICES * layout.stride);
+        pool->EBO = createBuffer(0, 0, INITIAL_INDICES * pool->IndexSize());
+        setupVertexArray(*pool);
+        pools.push_back(pool);
+        return *pool;
+    }
+
+    // doubles `allocator` (and the buffer behind it) until `needed` more elements fit at its end
+    void grow(GeometryPool &pool, unsigned int &buffer, RangeAllocator &allocator, size_t elementSize, size_t needed)
+    {
+        size_t oldCapacity = allocator.Capacity();
+        size_t newCapacity = oldCapacity * 2;
+        while (newCapacity < oldCapacity + needed)
+            newCapacity *= 2;
+        unsigned int grown = createBuffer(buffer, oldCapacity * elementSize, newCapacity * elementSize);
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+        allocator.Grow(newCapacity);
+        setupVertexArray(pool);
+        pool.generation++;
+    }
+
+    // new buffer of `bytes`, starting with the first `copyBytes` of `source`
+    static unsigned int createBuffer(unsigned int source, size_t copyBytes, size_t bytes)
+    {
+        unsigned int buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        if (source != 0 && copyBytes > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, source);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, copyBytes);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+
+    // points the pool VAO at the pool's current buffers
+    static void setupVertexArray(const GeometryPool &pool)
+    {
+        GLStateCache &cache = GLStateCache::Instance();
+        cache.BindVertexArray(pool.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+        pool.layout->Setup();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+        cache.BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,178 @@
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include <learnopengl/geometry_arena.h>
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// counted reference to geometry handed out by GeometryRegistry::Acquire. copies share the geometry; when the last one
+// is destroyed the registry frees its arena ranges and its entry.
+class GeometryRef
+{
+public:
+    GeometryRef() = default;
+
+    // adopts one reference the registry already counted
+    explicit GeometryRef(GeometryBuffers* buffers) : buffers(buffers)
+    {
+    }
+
+    GeometryRef(const GeometryRef &other) : buffers(other.buffers)
+    {
+        if (buffers)
+            buffers->refCount++;
+    }
+
+    GeometryRef(GeometryRef &&other) noexcept : buffers(other.buffers)
+    {
+        other.buffers = nullptr;
+    }
+
+    GeometryRef &operator=(GeometryRef other)
+    {
+        std::swap(buffers, other.buffers);
+        return *this;
+    }
+
+    inline ~GeometryRef();
+
+    GeometryBuffers* operator->() const
+    {
+        return buffers;
+    }
+
+    GeometryBuffers* get() const
+    {
+        return buffers;
+    }
+
+    bool operator==(const GeometryRef &other) const
+    {
+        return buffers == other.buffers;
+    }
+
+    bool operator!=(const GeometryRef &other) const
+    {
+        return buffers != other.buffers;
+    }
+
+private:
+    GeometryBuffers* buffers = nullptr;
+};
+
+// content-addressed registry in front of the arena uploads in Mesh::setupMesh. several meshes (and therefore several
+// models) point to the same GeometryBuffers when their post-processed geometry is byte-for-byte identical, e.g. the
+// planet spheres.
+// geometry is keyed by a 64-bit FNV-1a hash of the raw vertex and index bytes; hash hits are verified against the
+// stored streams so a collision can never hand out the wrong buffers. entries live as long as a GeometryRef to them.
+class GeometryRegistry
+{
+public:
+    static GeometryRegistry& Instance()
+    {
+        static GeometryRegistry registry;
+        return registry;
+    }
+
+    // returns the buffers for the given streams, calling `create` only when no identical geometry was registered yet.
+    template<typename VertexT, typename CreateFn>
+    GeometryRef Acquire(const std::vector<VertexT>& vertices, const std::vector<unsigned int>& indices, CreateFn create)
+    {
+        const void* vertexData = vertices.empty() ? nullptr : (const void*)&vertices[0];
+        const void* indexData = indices.empty() ? nullptr : (const void*)&indices[0];
+        size_t vertexBytes = vertices.size() * sizeof(VertexT);
+        size_t indexBytes = indices.size() * sizeof(unsigned int);
+
+        uint64_t key = Hash(vertexData, vertexBytes, Hash(indexData, indexBytes, FNV_OFFSET));
+        auto range = entries.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            Entry& entry = it->second;
+            if (entry.vertexBytes.size() == vertexBytes && entry.indexBytes.size() == indexBytes &&
+                (vertexBytes == 0 || std::memcmp(&entry.vertexBytes[0], vertexData, vertexBytes) == 0) &&
+                (indexBytes == 0 || std::memcmp(&entry.indexBytes[0], indexData, indexBytes) == 0))
+            {
+                entry.buffers->refCount++;
+                return GeometryRef(entry.buffers);
+            }
+        }
+
+        Entry entry;
+        entry.buffers = new GeometryBuffers(create());
+        entry.buffers->refCount = 1;
+        entry.buffers->contentHash = key;
+        entry.vertexBytes.assign((const unsigned char*)vertexData, (const unsigned char*)vertexData + vertexBytes);
+        entry.indexBytes.assign((const unsigned char*)indexData, (const unsigned char*)indexData + indexBytes);
+        GeometryBuffers* buffers = entry.buffers;
+        entries.emplace(key, std::move(entry));
+        return GeometryRef(buffers);
+    }
+
+    // drops one reference; the last one returns the arena ranges and frees the entry with its copy of the streams
+    void Release(GeometryBuffers* buffers)
+    {
+        if (--buffers->refCount > 0)
+            return;
+        auto range = entries.equal_range(buffers->contentHash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.buffers != buffers)
+                continue;
+            GeometryArena::Instance().Release(*buffers);
+            delete buffers;
+            entries.erase(it);
+            return;
+        }
+    }
+
+    // number of distinct geometries currently uploaded to the GPU
+    size_t UniqueCount() const
+    {
+        return entries.size();
+    }
+
+    // live references to registered geometry, counting every mesh that reused buffers
+    size_t ReferenceCount() const
+    {
+        size_t total = 0;
+        for (const auto& it : entries)
+            total += it.second.buffers->refCount;
+        return total;
+    }
+
+private:
+    struct Entry {
+        GeometryBuffers* buffers = nullptr;
+        std::vector<unsigned char> vertexBytes;
+        std::vector<unsigned char> indexBytes;
+    };
+
+    static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+    static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+    std::unordered_multimap<uint64_t, Entry> entries;
+
+    GeometryRegistry() = default;
+
+    static uint64_t Hash(const void* data, size_t size, uint64_t hash)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+};
+
+GeometryRef::~GeometryRef()
+{
+    if (buffers)
+        GeometryRegistry::Instance().Release(buffers);
+}
+#endif
@@ -0,0 +1,139 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <string>
+
+// glad is generated for core 3.3 without extensions, so tokens and queries for the optional features we use on top of
+// it live here.
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC_)(GLenum mode, GLenum type, const void *indirect,
+                                                              GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_)(GLuint program, GLsizei bufSize, GLsizei *length,
+                                                     GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_)(GLuint program, GLenum binaryFormat, const void *binary,
+                                                  GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_)(GLuint count);
+
+// one command of glMultiDrawElementsIndirect, layout fixed by the GL spec
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+namespace GLExtensions {
+
+    // true when the current context advertises the extension. must be called with a current context.
+    inline bool Has(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+            if (extension && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // true when the context version is at least major.minor
+    inline bool HasVersion(int major, int minor)
+    {
+        GLint contextMajor = 0, contextMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+        return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+    }
+
+    // glMultiDrawElementsIndirect, or null when the context can't draw indirect commands with a base instance
+    // (GL 4.3, or ARB_multi_draw_indirect + ARB_base_instance). filled by Load.
+    inline PFNGLMULTIDRAWELEMENTSINDIRECTPROC_ &MultiDrawElementsIndirect()
+    {
+        static PFNGLMULTIDRAWELEMENTSINDIRECTPROC_ function = nullptr;
+        return function;
+    }
+
+    // glGetProgramBinary, glProgramBinary and glProgramParameteri, or null without program binaries (GL 4.1 or
+    // ARB_get_program_binary) or when the driver supports no binary format at all. filled by Load.
+    inline PFNGLGETPROGRAMBINARYPROC_ &GetProgramBinary()
+    {
+        static PFNGLGETPROGRAMBINARYPROC_ function = nullptr;
+        return function;
+    }
+
+    inline PFNGLPROGRAMBINARYPROC_ &ProgramBinary()
+    {
+        static PFNGLPROGRAMBINARYPROC_ function = nullptr;
+        return function;
+    }
+
+    inline PFNGLPROGRAMPARAMETERIPROC_ &ProgramParameteri()
+    {
+        static PFNGLPROGRAMPARAMETERIPROC_ function = nullptr;
+        return function;
+    }
+
+    // glMaxShaderCompilerThreadsKHR (or its ARB twin), or null when the driver can't report GL_COMPLETION_STATUS_KHR
+    // of compiles and links running in the background. filled by Load.
+    inline PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_ &MaxShaderCompilerThreads()
+    {
+        static PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_ function = nullptr;
+        return function;
+    }
+
+    // resolves the entry points above with the window system's loader; call once after gladLoadGLLoader
+    inline void Load(GLADloadproc load)
+    {
+        if (HasVersion(4, 3) || (Has("GL_ARB_multi_draw_indirect") && Has("GL_ARB_base_instance")))
+            MultiDrawElementsIndirect() = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC_) load("glMultiDrawElementsIndirect");
+        if (HasVersion(4, 1) || Has("GL_ARB_get_program_binary"))
+        {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            if (formats > 0)
+            {
+                GetProgramBinary() = (PFNGLGETPROGRAMBINARYPROC_) load("glGetProgramBinary");
+                ProgramBinary() = (PFNGLPROGRAMBINARYPROC_) load("glProgramBinary");
+                ProgramParameteri() = (PFNGLPROGRAMPARAMETERIPROC_) load("glProgramParameteri");
+            }
+        }
+        if (Has("GL_KHR_parallel_shader_compile"))
+            MaxShaderCompilerThreads() = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_) load("glMaxShaderCompilerThreadsKHR");
+        else if (Has("GL_ARB_parallel_shader_compile"))
+            MaxShaderCompilerThreads() = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC_) load("glMaxShaderCompilerThreadsARB");
+        // as many compiler threads as the driver likes, some start with none
+        if (MaxShaderCompilerThreads())
+            MaxShaderCompilerThreads()(0xFFFFFFFF);
+    }
+}
+#endif
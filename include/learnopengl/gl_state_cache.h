@@ -0,0 +1,171 @@
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+// fixed function state of a draw. every field is always applied, so a draw never inherits state from the one before.
+struct RenderState {
+    bool cullFace = true;
+    bool blend = false;
+    GLenum blendSource = GL_SRC_ALPHA;
+    GLenum blendDestination = GL_ONE_MINUS_SRC_ALPHA;
+    bool depthTest = true;
+    bool depthWrite = true;
+    GLenum depthFunc = GL_LESS;
+
+    static RenderState Opaque()
+    {
+        return RenderState();
+    }
+
+    // alpha blended, tested against but not written to the depth buffer
+    static RenderState Transparent()
+    {
+        RenderState state;
+        state.blend = true;
+        state.depthWrite = false;
+        state.depthFunc = GL_LEQUAL;
+        return state;
+    }
+
+    // the skybox is drawn from the inside at the far plane
+    static RenderState Sky()
+    {
+        RenderState state;
+        state.cullFace = false;
+        state.depthFunc = GL_LEQUAL;
+        return state;
+    }
+};
+
+// shadow copy of the GL state the render loop changes most: program, VAO, texture bindings and RenderState. calls that
+// would set what is already set are dropped. everything in the tree, uploads included, binds through the cache, so it
+// stays valid across frames; code that changes this state with raw GL calls must be followed by an Invalidate.
+// ImGui's renderer restores what it changes and needs none.
+class GLStateCache
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    static GLStateCache &Instance()
+    {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    GLStateCache(const GLStateCache&) = delete;
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    // forgets everything, the next call of every kind reaches GL
+    void Invalidate()
+    {
+        known = false;
+        program = vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (TextureBinding &binding : textures)
+            binding.target = 0;
+    }
+
+    void ResetCounters()
+    {
+        issued = skipped = 0;
+    }
+
+    void Apply(const RenderState &next)
+    {
+        setCapability(GL_CULL_FACE, state.cullFace, next.cullFace);
+        setCapability(GL_BLEND, state.blend, next.blend);
+        setCapability(GL_DEPTH_TEST, state.depthTest, next.depthTest);
+        if (count(!known || state.blendSource != next.blendSource || state.blendDestination != next.blendDestination))
+            glBlendFunc(next.blendSource, next.blendDestination);
+        if (count(!known || state.depthWrite != next.depthWrite))
+            glDepthMask(next.depthWrite ? GL_TRUE : GL_FALSE);
+        if (count(!known || state.depthFunc != next.depthFunc))
+            glDepthFunc(next.depthFunc);
+        state = next;
+        known = true;
+    }
+
+    void UseProgram(unsigned int id)
+    {
+        if (count(program != id))
+            glUseProgram(program = id);
+    }
+
+    void BindVertexArray(unsigned int id)
+    {
+        if (count(vertexArray != id))
+            glBindVertexArray(vertexArray = id);
+    }
+
+    void BindTexture(unsigned int unit, GLenum target, unsigned int id)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+        {
+            activeTexture(unit);
+            glBindTexture(target, id);
+            return;
+        }
+        // one binding is remembered per unit; binding another target there is always issued
+        TextureBinding &binding = textures[unit];
+        if (!count(binding.target != target || binding.id != id))
+            return;
+        activeTexture(unit);
+        glBindTexture(target, id);
+        binding.target = target;
+        binding.id = id;
+    }
+
+    // GL calls made and dropped since the last ResetCounters
+    unsigned int Issued() const
+    {
+        return issued;
+    }
+
+    unsigned int Skipped() const
+    {
+        return skipped;
+    }
+
+private:
+    static const unsigned int UNKNOWN = ~0u;
+
+    struct TextureBinding {
+        GLenum target = 0;      // 0 when unknown
+        unsigned int id = 0;
+    };
+
+    RenderState state;
+    bool known = false;
+    unsigned int program = UNKNOWN, vertexArray = UNKNOWN, activeUnit = UNKNOWN;
+    TextureBinding textures[MAX_TEXTURE_UNITS];
+    unsigned int issued = 0, skipped = 0;
+
+    GLStateCache() = default;
+
+    bool count(bool changed)
+    {
+        if (changed)
+            issued++;
+        else
+            skipped++;
+        return changed;
+    }
+
+    void setCapability(GLenum capability, bool current, bool next)
+    {
+        if (!count(!known || current != next))
+            return;
+        if (next)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (activeUnit != unit)
+            glActiveTexture(GL_TEXTURE0 + (activeUnit = unit));
+    }
+};
+#endif
@@ -0,0 +1,421 @@
+#ifndef INSTANCED_RENDERER_H
+#define INSTANCED_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/gl_extensions.h>
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
+#include <learnopengl/texture_array.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// per-instance attributes read by the INSTANCED variant of model_lighting.vs (locations 5-13)
+struct InstanceData {
+    glm::mat4 model;
+    glm::vec4 color;          // rgb tint, a = alpha
+    glm::mat3 normalMatrix;   // transpose(inverse(mat3(model))), see NormalMatrices
+    float layer;              // texture array layer of the instance's material
+};
+
+// collects bodies for one pass and draws all instances that share geometry, detail level and material as one instanced
+// draw. Every frame: Clear, Add each body, Draw.
+// all meshes live in the geometry arena, so batches only differ in their index range and base vertex: with
+// glMultiDrawElementsIndirect (see GLExtensions::Load) every run of batches sharing a pool and textures is a single
+// call; on plain GL 3.3 each batch is a glDrawElementsInstancedBaseVertex on the same VAO.
+// with a material table the diffuse maps come from its texture arrays and the instance layer picks the map, so bodies
+// that only differ in their planet texture share a batch; without one each mesh's own textures are bound.
+class InstancedRenderer
+{
+public:
+    explicit InstancedRenderer(const MaterialTable* materials = nullptr) : materials(materials)
+    {
+        glGenBuffers(1, &instanceVBO);
+        glGenBuffers(1, &indirectBuffer);
+    }
+
+    ~InstancedRenderer()
+    {
+        for (auto &it : vaos)
+            glDeleteVertexArrays(1, &it.second.vao);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteBuffers(1, &indirectBuffer);
+    }
+
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+    // largest on-screen error, in pixels, allowed when Add picks a mesh's detail level
+    float maxPixelError = 1.0f;
+
+    // batches that got no instance since the previous Clear are dropped, so meshes that went away don't keep their
+    // geometry alive here
+    void Clear()
+    {
+        batches.erase(std::remove_if(batches.begin(), batches.end(), [](const Batch &batch) {
+            return batch.instances.empty();
+        }), batches.end());
+        for (Batch &batch : batches)
+            batch.instances.clear();
+    }
+
+    // queues every mesh of the model with the given transform and its normal matrix, tint/alpha and texture layer. the layer is ignored when a
+    // material table is used, the table's layer for the mesh's diffuse map is taken instead. `pixelsPerUnit` is the
+    // on-screen size of one model unit and selects the detail level of each mesh; negative draws full detail.
+    void Add(Model &model, const glm::mat4 &modelMatrix, const glm::mat3 &normalMatrix,
+             const glm::vec4 &color = glm::vec4(1.0f), float layer = 0.0f, float pixelsPerUnit = -1.0f)
+    {
+        InstanceData instance;
+        instance.model = modelMatrix;
+        instance.normalMatrix = normalMatrix;
+        instance.color = color;
+        instance.layer = layer;
+        for (Mesh &mesh : model.meshes)
+        {
+            unsigned int lod = MeshLodBuilder::Select(mesh.lods, pixelsPerUnit, maxPixelError);
+            if (materials)
+            {
+                MaterialSlot slot = materials->Lookup(mesh);
+                instance.layer = slot.layer;
+                batchFor(mesh, lod, slot).instances.push_back(instance);
+            }
+            else
+                batchFor(mesh, lod, MaterialSlot()).instances.push_back(instance);
+        }
+    }
+
+    // uploads all queued instances once, then draws the batches grouped by pool and bound textures with `shader`
+    void Draw(Shader &shader)
+    {
+        draw([&shader](const Batch &) -> Shader * {
+            return &shader;
+        });
+    }
+
+    // the same with one variant of `variants` per material: `features`, plus HAS_SPECULAR_MAP for materials that have a
+    // specular map, or a ready stand-in while that one still compiles (ShaderVariants::Best). batches without any ready
+    // variant are skipped. `setup` sets the pass' uniforms on each variant before its first batch.
+    void Draw(ShaderVariants &variants, unsigned int features, const std::function<void(Shader &)> &setup)
+    {
+        preparedShaders.clear();
+        draw([&](const Batch &batch) -> Shader * {
+            Shader *shader = variants.Best(features | (hasSpecularMap(batch) ? ShaderVariants::HAS_SPECULAR_MAP : 0));
+            if (shader && std::find(preparedShaders.begin(), preparedShaders.end(), shader) == preparedShaders.end())
+            {
+                GLStateCache::Instance().UseProgram(shader->ID);
+                setup(*shader);
+                preparedShaders.push_back(shader);
+            }
+            return shader;
+        });
+    }
+
+private:
+    // the Draw overloads: `shaderFor` picks the program of a batch, null skips it
+    template<typename ShaderFor>
+    void draw(ShaderFor shaderFor)
+    {
+        order.clear();
+        size_t total = 0;
+        for (size_t i = 0; i < batches.size(); i++)
+        {
+            if (batches[i].instances.empty())
+                continue;
+            order.push_back(i);
+            total += batches[i].instances.size();
+        }
+        if (total == 0)
+            return;
+        std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return drawsBefore(batches[a], batches[b]);
+        });
+
+        staging.clear();
+        for (size_t i : order)
+            staging.insert(staging.end(), batches[i].instances.begin(), batches[i].instances.end());
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (total > capacity)
+        {
+            capacity = total * 2;
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, total * sizeof(InstanceData), &staging[0]);
+
+        PFNGLMULTIDRAWELEMENTSINDIRECTPROC_ multiDraw = GLExtensions::MultiDrawElementsIndirect();
+        if (multiDraw)
+            uploadCommands();
+
+        size_t first = 0;
+        for (size_t run = 0; run < order.size();)
+        {
+            // batches [run, end) share the pool and the bound textures
+            size_t end = run + 1;
+            while (end < order.size() && sameBinding(batches[order[run]], batches[order[end]]))
+                end++;
+            Batch &head = batches[order[run]];
+            Shader *shader = shaderFor(head);
+            if (!shader)
+            {
+                for (size_t i = run; i < end; i++)
+                    first += batches[order[i]].instances.size();
+                run = end;
+                continue;
+            }
+            GLStateCache::Instance().UseProgram(shader->ID);
+            if (materials)
+                bindMaterial(*shader, head.material);
+            else
+                head.mesh->BindTextures(*shader);
+            GeometryPool &pool = *head.geometry->pool;
+            vaoFor(pool);
+            if (multiDraw)
+            {
+                // base instance picks each command's instances, the attributes stay at the start of the buffer
+                setupInstanceAttributes(0);
+                multiDraw(GL_TRIANGLES, pool.indexType, (const void*)(run * sizeof(DrawElementsIndirectCommand)),
+                          (GLsizei) (end - run), 0);
+            }
+            else
+            {
+                for (size_t i = run; i < end; i++)
+                {
+                    Batch &batch = batches[order[i]];
+                    // no base instance in GL 3.3, so the instance attributes are re-pointed at this batch's range
+                    setupInstanceAttributes(first * sizeof(InstanceData));
+                    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei) batch.count, pool.indexType,
+                                                      (const void*)(batch.firstIndex * pool.IndexSize()),
+                                                      (GLsizei) batch.instances.size(), batch.geometry->baseVertex);
+                    first += batch.instances.size();
+                }
+            }
+            run = end;
+        }
+        if (multiDraw)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // one instanced draw: the instances sharing geometry, detail level and material. only the index range is kept, not
+    // a copy of the mesh
+    struct Batch {
+        GeometryRef geometry;
+        unsigned int lod;
+        // the detail level's range in the pool's index buffer
+        unsigned int firstIndex, count;
+        MaterialSlot material;
+        // without a material table: the textures the batch is keyed by, and the mesh of its latest Add that binds them.
+        // the pointer is only used while the batch has instances, i.e. in the frame it was set
+        vector<Texture> textures;
+        std::string glslIdentifierPrefix;
+        Mesh* mesh;
+        vector<InstanceData> instances;
+    };
+
+    // instance attribute VAO of a geometry pool, rebuilt when the pool's buffers grew
+    struct PoolVertexArray {
+        unsigned int vao = 0;
+        unsigned int generation = 0;
+    };
+
+    const MaterialTable* materials;
+    unsigned int instanceVBO = 0;
+    size_t capacity = 0;
+    unsigned int indirectBuffer = 0;
+    size_t commandCapacity = 0;
+    vector<Batch> batches;
+    // non-empty batches in draw order
+    vector<size_t> order;
+    vector<InstanceData> staging;
+    vector<DrawElementsIndirectCommand> commands;
+    // variants whose pass uniforms are set in the current Draw
+    vector<Shader*> preparedShaders;
+    unsigned int uniformShaderID = 0;
+    UniformHandle diffuseArrayUniform, specularUniform;
+    // one VAO per arena pool: the pool's vertex/index buffers plus the instance buffer
+    map<GeometryPool*, PoolVertexArray> vaos;
+
+    // batches are keyed by geometry, detail level and bound texture set (array texture and specular map with a material
+    // table); a model that finishes streaming simply starts a new batch
+    Batch &batchFor(Mesh &mesh, unsigned int lod, const MaterialSlot &material)
+    {
+        for (Batch &batch : batches)
+        {
+            if (batch.geometry != mesh.geometry || batch.lod != lod)
+                continue;
+            if (materials ? batch.material.arrayTexture == material.arrayTexture &&
+                            batch.material.specularTexture == material.specularTexture
+                          : sameTextures(batch.textures, mesh.textures) &&
+                            batch.glslIdentifierPrefix == mesh.glslIdentifierPrefix)
+            {
+                batch.mesh = &mesh;
+                return batch;
+            }
+        }
+        Batch batch;
+        batch.geometry = mesh.geometry;
+        batch.lod = lod;
+        batch.firstIndex = mesh.FirstIndex(lod);
+        batch.count = mesh.lods[lod].count;
+        batch.material = material;
+        if (!materials)
+        {
+            batch.textures = mesh.textures;
+            batch.glslIdentifierPrefix = mesh.glslIdentifierPrefix;
+        }
+        batch.mesh = &mesh;
+        batches.push_back(std::move(batch));
+        return batches.back();
+    }
+
+    // diffuse array on unit 0, specular map on unit 1. meshes without a specular map reuse the diffuse colour, see the
+    // HAS_SPECULAR_MAP shader variant.
+    void bindMaterial(Shader &shader, const MaterialSlot &material)
+    {
+        if (uniformShaderID != shader.ID)
+        {
+            uniformShaderID = shader.ID;
+            diffuseArrayUniform = shader.GetUniform("material.diffuseArray");
+            specularUniform = shader.GetUniform("material.texture_specular1");
+        }
+        GLStateCache &cache = GLStateCache::Instance();
+        cache.BindTexture(0, GL_TEXTURE_2D_ARRAY, material.arrayTexture);
+        shader.setInt(diffuseArrayUniform, 0);
+        cache.BindTexture(1, GL_TEXTURE_2D, material.specularTexture);
+        shader.setInt(specularUniform, 1);
+    }
+
+    // pools in creation order, then grouped by specular map presence, array texture and specular map so equal bindings
+    // end up adjacent
+    bool drawsBefore(const Batch &a, const Batch &b) const
+    {
+        const GeometryPool* poolA = a.geometry->pool;
+        const GeometryPool* poolB = b.geometry->pool;
+        if (poolA != poolB)
+            return poolA->index < poolB->index;
+        // one program switch at most between the variants with and without specular map
+        if (hasSpecularMap(a) != hasSpecularMap(b))
+            return hasSpecularMap(b);
+        if (!materials)
+            return false;
+        if (a.material.arrayTexture != b.material.arrayTexture)
+            return a.material.arrayTexture < b.material.arrayTexture;
+        return a.material.specularTexture < b.material.specularTexture;
+    }
+
+    bool sameBinding(const Batch &a, const Batch &b) const
+    {
+        if (a.geometry->pool != b.geometry->pool)
+            return false;
+        if (materials)
+            return a.material.arrayTexture == b.material.arrayTexture &&
+                   a.material.specularTexture == b.material.specularTexture;
+        return sameTextures(a.textures, b.textures) && a.glslIdentifierPrefix == b.glslIdentifierPrefix;
+    }
+
+    // one indirect command per batch, in draw order
+    void uploadCommands()
+    {
+        commands.clear();
+        GLuint first = 0;
+        for (size_t i : order)
+        {
+            const Batch &batch = batches[i];
+            DrawElementsIndirectCommand command;
+            command.count = batch.count;
+            command.instanceCount = (GLuint) batch.instances.size();
+            command.firstIndex = batch.firstIndex;
+            command.baseVertex = (GLint) batch.geometry->baseVertex;
+            command.baseInstance = first;
+            commands.push_back(command);
+            first += command.instanceCount;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        if (commands.size() > commandCapacity)
+        {
+            commandCapacity = commands.size() * 2;
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+        }
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0]);
+    }
+
+    bool hasSpecularMap(const Batch &batch) const
+    {
+        if (materials)
+            return batch.material.specularTexture != 0;
+        for (const Texture &texture : batch.textures)
+        {
+            if (texture.type == "texture_specular")
+                return true;
+        }
+        return false;
+    }
+
+    static bool sameTextures(const vector<Texture> &a, const vector<Texture> &b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (unsigned int i = 0; i < a.size(); i++)
+        {
+            if (a[i].id != b[i].id || a[i].type != b[i].type)
+                return false;
+        }
+        return true;
+    }
+
+    // binds and returns the VAO for `pool`, (re)pointing it at the pool's buffers when they are new or have grown
+    unsigned int vaoFor(GeometryPool &pool)
+    {
+        PoolVertexArray &vertexArray = vaos[&pool];
+        bool stale = vertexArray.vao == 0 || vertexArray.generation != pool.generation;
+        if (vertexArray.vao == 0)
+            glGenVertexArrays(1, &vertexArray.vao);
+        GLStateCache::Instance().BindVertexArray(vertexArray.vao);
+        if (stale)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+            pool.layout->Setup();
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.EBO);
+            vertexArray.generation = pool.generation;
+        }
+        return vertexArray.vao;
+    }
+
+    // instance attributes of the bound VAO, read from the instance buffer starting at `offset`
+    void setupInstanceAttributes(size_t offset)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        // model matrix, one column per location
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(5 + column);
+            glVertexAttribPointer(5 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(5 + column, 1);
+        }
+        // tint and alpha
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, color)));
+        glVertexAttribDivisor(9, 1);
+        // texture array layer
+        glEnableVertexAttribArray(10);
+        glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, layer)));
+        glVertexAttribDivisor(10, 1);
+        // normal matrix, one column per location
+        for (unsigned int column = 0; column < 3; column++)
+        {
+            glEnableVertexAttribArray(11 + column);
+            glVertexAttribPointer(11 + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void*)(offset + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+            glVertexAttribDivisor(11 + column, 1);
+        }
+    }
+};
+#endif
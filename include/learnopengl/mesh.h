@@ -7,6 +7,10 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/geometry_registry.h>
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/mesh_lod.h>
+#include <learnopengl/vertex_layout.h>
 
 #include <string>
 #include <vector>
@@ -39,32 +43,97 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    // index ranges of the detail levels, full detail first; all of them live in `indices`
+    vector<MeshLod>      lods;
 
+    // VAO of the arena pool holding the mesh, shared with every other mesh in that pool
     unsigned int VAO;
+    // how `vertices` are stored in the vertex buffer
+    const VertexLayout* layout;
+    // GL_UNSIGNED_SHORT when every index fits in 16 bits, GL_UNSIGNED_INT otherwise
+    GLenum indexType;
     std::string glslIdentifierPrefix;
+    // arena ranges shared with every other mesh whose vertex/index streams are identical, released with the last copy
+    GeometryRef geometry;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<MeshLod> lods = vector<MeshLod>())
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->lods = lods;
+        // without a LOD chain the whole index buffer is the only level
+        if (this->lods.empty())
+        {
+            this->lods.resize(1);
+            this->lods[0].count = (unsigned int) this->indices.size();
+        }
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    // render the mesh at the given detail level. bindings go through the state cache and are left in place, so
+    // meshes sharing a pool or textures don't rebind them.
+    void Draw(Shader &shader, unsigned int lod = 0)
+    {
+        BindTextures(shader);
+
+        // draw mesh
+        GLStateCache::Instance().BindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].count, indexType, IndexOffset(lod), geometry->baseVertex);
+    }
+
+    // binds the mesh textures to units 0..N-1 and points the shader's samplers at them
+    void BindTextures(Shader &shader)
+    {
+        // sampler handles are resolved once per shader/prefix, not on every draw
+        if (samplerShaderID != shader.ID || samplerPrefix != glslIdentifierPrefix)
+            resolveSamplers(shader);
+
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            // set the sampler to the texture unit and bind the texture there
+            shader.setInt(samplerHandles[i], i);
+            GLStateCache::Instance().BindTexture(i, GL_TEXTURE_2D, textures[i].id);
+        }
+    }
+
+    // first index of a detail level in the pool's index buffer; indices are relative to geometry->baseVertex
+    unsigned int FirstIndex(unsigned int lod) const
+    {
+        return geometry->firstIndex + lods[lod].first;
+    }
+
+    // the same as a byte offset, for glDrawElements*
+    const void* IndexOffset(unsigned int lod) const
+    {
+        return (const void*)(FirstIndex(lod) * geometry->pool->IndexSize());
+    }
+
+    // layout of the vertex buffers of meshes created from now on; set before loading models
+    static const VertexLayout* &DefaultLayout()
+    {
+        static const VertexLayout* defaultLayout = &VertexLayout::Compact();
+        return defaultLayout;
+    }
+
+private:
+    // sampler uniforms of the shader last used in Draw, one per texture
+    vector<UniformHandle> samplerHandles;
+    unsigned int samplerShaderID = 0;
+    std::string samplerPrefix;
+
+    // maps every texture to its sampler name (the N in diffuse_textureN) and resolves it in the shader
+    void resolveSamplers(const Shader &shader)
     {
-        // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerHandles.clear();
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
             if(name == "texture_diffuse")
@@ -75,65 +144,38 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            samplerHandles.push_back(shader.GetUniform(glslIdentifierPrefix + name + number));
         }
-
-
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        samplerShaderID = shader.ID;
+        samplerPrefix = glslIdentifierPrefix;
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
+    // looks up identical geometry in the registry and only uploads it to the arena when none was uploaded before.
+    // the registry compares the packed bytes, so the same vertices in another layout get their own ranges.
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        layout = DefaultLayout();
+        // 16 bit indices whenever every index fits: up to 65536 vertices, whose largest index is 65535
+        indexType = vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        vector<unsigned char> packed = layout->Pack(vertices);
+        geometry = GeometryRegistry::Instance().Acquire(packed, indices, [this, &packed]() {
+            return upload(packed);
+        });
+        VAO = geometry->pool->VAO;
+    }
+
+    // copies the packed vertices and the indices into the arena pool for the mesh's layout and index type
+    GeometryBuffers upload(const vector<unsigned char> &packed)
+    {
+        // indices stay 32 bit on the CPU (mesh cache, LOD building), the GPU gets half the bytes whenever they fit
+        if (indexType == GL_UNSIGNED_SHORT)
+        {
+            vector<unsigned short> shortIndices(indices.begin(), indices.end());
+            return GeometryArena::Instance().Upload(*layout, indexType, packed.data(), vertices.size(),
+                                                    shortIndices.data(), shortIndices.size());
+        }
+        return GeometryArena::Instance().Upload(*layout, indexType, packed.data(), vertices.size(),
+                                                indices.data(), indices.size());
     }
 };
 #endif
\ No newline at end of file
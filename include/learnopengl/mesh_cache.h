@@ -0,0 +1,269 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/mesh.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// CPU side result of importing one mesh: everything Model needs to build a Mesh without going through Assimp again.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    // texture references as (type, path relative to the model directory)
+    vector<pair<string, string>> textures;
+    // sphere around the vertices, in model space
+    BoundingSphere bounds;
+    // detail levels as ranges of `indices`, full detail first
+    vector<MeshLod> lods;
+};
+
+// binary cache of baked meshes stored next to the source asset as <asset>.meshcache.
+// layout (native endianness, everything 4 byte aligned):
+//   header | per mesh: vertexCount, indexCount, textureCount, lodCount, bounds, vertices, indices, lods,
+//            (typeLen, type, pathLen, path)*
+// the header records the source size, mtime and content hash; a cache is used when size+mtime match, or when the
+// content hash still matches after the mtime changed (e.g. fresh checkout).
+namespace MeshCache {
+
+    const uint32_t MAGIC = 0x434d4752; // "RGMC"
+    // bump whenever Vertex, the baked layout or the import-time processing changes
+    const uint32_t VERSION = 4;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        uint64_t sourceSize;
+        int64_t  sourceMTime;
+        uint64_t sourceHash;
+    };
+
+    struct SourceStamp {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+    };
+
+    inline string CachePath(const string& source)
+    {
+        return source + ".meshcache";
+    }
+
+    inline bool StatSource(const string& source, SourceStamp& stamp)
+    {
+        struct stat st;
+        if (stat(source.c_str(), &st) != 0)
+            return false;
+        stamp.size = (uint64_t) st.st_size;
+        stamp.mtime = (int64_t) st.st_mtime;
+        return true;
+    }
+
+    // FNV-1a over the whole source file
+    inline uint64_t HashSource(const string& source)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        FILE* file = fopen(source.c_str(), "rb");
+        if (!file)
+            return 0;
+        unsigned char buffer[1 << 16];
+        size_t read;
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            for (size_t i = 0; i < read; i++)
+            {
+                hash ^= buffer[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+        fclose(file);
+        return hash;
+    }
+
+    // small cursor over the mapped file that refuses to read past its end
+    struct Reader {
+        const unsigned char* data;
+        size_t size;
+        size_t offset;
+
+        size_t Remaining() const
+        {
+            return offset < size ? size - offset : 0;
+        }
+
+        // true when `count` elements of `elementSize` bytes can still be read; checked before anything is allocated
+        // for counts taken from the file, so a truncated or corrupt cache is rejected instead of throwing bad_alloc
+        bool Fits(size_t count, size_t elementSize) const
+        {
+            return count <= Remaining() / elementSize;
+        }
+
+        bool Read(void* dst, size_t bytes)
+        {
+            if (bytes > Remaining())
+                return false;
+            memcpy(dst, data + offset, bytes);
+            offset += (bytes + 3) & ~size_t(3);
+            return true;
+        }
+
+        bool ReadString(string& str)
+        {
+            uint32_t length;
+            if (!Read(&length, sizeof(length)) || length > Remaining())
+                return false;
+            str.assign((const char*) data + offset, length);
+            offset += (length + 3) & ~size_t(3);
+            return true;
+        }
+    };
+
+    inline void Write(FILE* file, const void* src, size_t bytes)
+    {
+        static const unsigned char padding[4] = {0, 0, 0, 0};
+        fwrite(src, 1, bytes, file);
+        fwrite(padding, 1, ((bytes + 3) & ~size_t(3)) - bytes, file);
+    }
+
+    inline void WriteString(FILE* file, const string& str)
+    {
+        uint32_t length = (uint32_t) str.size();
+        Write(file, &length, sizeof(length));
+        Write(file, str.data(), length);
+    }
+
+    // every index addresses a vertex and every detail level is a range of `indices`, the first one starting at 0, so a
+    // corrupt cache can never draw outside the mesh's arena range
+    inline bool Consistent(const MeshData& mesh)
+    {
+        for (unsigned int index : mesh.indices)
+            if (index >= mesh.vertices.size())
+                return false;
+        if (!mesh.lods.empty() && mesh.lods[0].first != 0)
+            return false;
+        for (const MeshLod& lod : mesh.lods)
+            if (lod.first > mesh.indices.size() || lod.count > mesh.indices.size() - lod.first)
+                return false;
+        return true;
+    }
+
+    // memory-maps the cache of `source` and fills `meshes`. returns false when there is no usable cache.
+    inline bool Load(const string& source, vector<MeshData>& meshes)
+    {
+        SourceStamp stamp;
+        if (!StatSource(source, stamp))
+            return false;
+
+        int fd = open(CachePath(source).c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Header))
+        {
+            close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        Reader reader{(const unsigned char*) mapped, (size_t) st.st_size, 0};
+        Header header;
+        bool valid = reader.Read(&header, sizeof(header)) &&
+                     header.magic == MAGIC && header.version == VERSION && header.vertexSize == sizeof(Vertex) &&
+                     header.sourceSize == stamp.size &&
+                     (header.sourceMTime == stamp.mtime || header.sourceHash == HashSource(source)) &&
+                     reader.Fits(header.meshCount, 4 * sizeof(uint32_t) + sizeof(BoundingSphere));
+
+        vector<MeshData> loaded(valid ? header.meshCount : 0);
+        for (unsigned int i = 0; valid && i < loaded.size(); i++)
+        {
+            uint32_t counts[4];
+            MeshData& mesh = loaded[i];
+            valid = reader.Read(counts, sizeof(counts)) && reader.Read(&mesh.bounds, sizeof(BoundingSphere));
+            // every texture reference takes at least its two length fields
+            valid = valid && reader.Fits(counts[0], sizeof(Vertex)) && reader.Fits(counts[1], sizeof(unsigned int)) &&
+                    reader.Fits(counts[2], 2 * sizeof(uint32_t)) && reader.Fits(counts[3], sizeof(MeshLod));
+            if (!valid)
+                break;
+            mesh.vertices.resize(counts[0]);
+            mesh.indices.resize(counts[1]);
+            mesh.textures.resize(counts[2]);
+            mesh.lods.resize(counts[3]);
+            valid = (counts[0] == 0 || reader.Read(&mesh.vertices[0], counts[0] * sizeof(Vertex))) &&
+                    (counts[1] == 0 || reader.Read(&mesh.indices[0], counts[1] * sizeof(unsigned int))) &&
+                    (counts[3] == 0 || reader.Read(&mesh.lods[0], counts[3] * sizeof(MeshLod)));
+            for (unsigned int j = 0; valid && j < counts[2]; j++)
+                valid = reader.ReadString(mesh.textures[j].first) && reader.ReadString(mesh.textures[j].second);
+            valid = valid && Consistent(mesh);
+        }
+        munmap(mapped, (size_t) st.st_size);
+
+        if (valid)
+            meshes.swap(loaded);
+        return valid;
+    }
+
+    // writes the cache for `source`. goes through a temporary file so a crash never leaves a truncated cache behind.
+    inline void Store(const string& source, const vector<MeshData>& meshes)
+    {
+        SourceStamp stamp;
+        if (!StatSource(source, stamp))
+            return;
+
+        string path = CachePath(source);
+        string tmpPath = path + ".tmp";
+        FILE* file = fopen(tmpPath.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "WARNING::MESH_CACHE:: cannot write " << path << std::endl;
+            return;
+        }
+
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = (uint32_t) meshes.size();
+        header.sourceSize = stamp.size;
+        header.sourceMTime = stamp.mtime;
+        header.sourceHash = HashSource(source);
+        Write(file, &header, sizeof(header));
+
+        for (const MeshData& mesh : meshes)
+        {
+            uint32_t counts[4] = {(uint32_t) mesh.vertices.size(), (uint32_t) mesh.indices.size(),
+                                  (uint32_t) mesh.textures.size(), (uint32_t) mesh.lods.size()};
+            Write(file, counts, sizeof(counts));
+            Write(file, &mesh.bounds, sizeof(BoundingSphere));
+            if (!mesh.vertices.empty())
+                Write(file, &mesh.vertices[0], mesh.vertices.size() * sizeof(Vertex));
+            if (!mesh.indices.empty())
+                Write(file, &mesh.indices[0], mesh.indices.size() * sizeof(unsigned int));
+            if (!mesh.lods.empty())
+                Write(file, &mesh.lods[0], mesh.lods.size() * sizeof(MeshLod));
+            for (const auto& texture : mesh.textures)
+            {
+                WriteString(file, texture.first);
+                WriteString(file, texture.second);
+            }
+        }
+
+        bool ok = ferror(file) == 0;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+            remove(tmpPath.c_str());
+    }
+}
+#endif
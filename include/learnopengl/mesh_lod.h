@@ -0,0 +1,296 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+// one level of detail of a mesh: a range of the mesh's index buffer, drawn with the mesh's (shared) vertices
+struct MeshLod {
+    unsigned int first = 0;     // first index
+    unsigned int count = 0;     // number of indices
+    float error = 0.0f;         // how far (model units) the simplified surface may be from the original one
+};
+
+// import-time simplifier building the LOD chain of a mesh with quadric error metrics (Garland & Heckbert).
+// vertices are never moved or created: an edge collapse snaps one vertex onto a neighbour and only the index buffer
+// changes, so every level reuses the original vertex buffer. vertices on open borders or UV/normal seams (several
+// vertices at one position) stay locked, which keeps the silhouette and texture seams intact.
+namespace MeshLodBuilder {
+
+    // levels including the original mesh
+    const int MAX_LEVELS = 4;
+    // every level aims for this fraction of the previous level's triangles
+    const float LEVEL_RATIO = 0.5f;
+    // meshes, and levels, below this many triangles are not simplified further
+    const size_t MIN_TRIANGLES = 64;
+    // collapses moving the surface further than this fraction of the bounding radius are never made
+    const float MAX_RELATIVE_ERROR = 0.1f;
+
+    // area weighted sum of squared distances to the planes of the triangles merged into a vertex
+    struct Quadric {
+        double a2 = 0.0, b2 = 0.0, c2 = 0.0, ab = 0.0, ac = 0.0, bc = 0.0, ad = 0.0, bd = 0.0, cd = 0.0, d2 = 0.0;
+        double weight = 0.0;
+
+        static Quadric FromTriangle(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2)
+        {
+            Quadric q;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(normal);
+            if (length == 0.0)
+                return q;
+            double a = normal.x / length, b = normal.y / length, c = normal.z / length;
+            double d = -(a * p0.x + b * p0.y + c * p0.z);
+            double w = length * 0.5;
+            q.a2 = w * a * a; q.b2 = w * b * b; q.c2 = w * c * c;
+            q.ab = w * a * b; q.ac = w * a * c; q.bc = w * b * c;
+            q.ad = w * a * d; q.bd = w * b * d; q.cd = w * c * d;
+            q.d2 = w * d * d;
+            q.weight = w;
+            return q;
+        }
+
+        Quadric &operator+=(const Quadric &q)
+        {
+            a2 += q.a2; b2 += q.b2; c2 += q.c2;
+            ab += q.ab; ac += q.ac; bc += q.bc;
+            ad += q.ad; bd += q.bd; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+            return *this;
+        }
+
+        // mean squared distance of `p` to the planes
+        double Error(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double sum = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z) +
+                         2.0 * (ad * x + bd * y + cd * z) + d2;
+            return weight > 0.0 ? std::max(0.0, sum / weight) : 0.0;
+        }
+    };
+
+    // vertices that must not move: their position is shared with another vertex (seam) or lies on an open border
+    inline std::vector<unsigned char> LockedVertices(const std::vector<glm::vec3> &positions,
+                                                     const std::vector<unsigned int> &indices)
+    {
+        std::map<std::tuple<float, float, float>, unsigned int> firstAt;
+        std::vector<unsigned int> group(positions.size());
+        std::vector<unsigned int> groupSize(positions.size(), 0);
+        for (size_t v = 0; v < positions.size(); v++)
+        {
+            auto key = std::make_tuple(positions[v].x, positions[v].y, positions[v].z);
+            auto it = firstAt.insert(std::make_pair(key, (unsigned int) v)).first;
+            group[v] = it->second;
+            groupSize[group[v]]++;
+        }
+
+        // an edge is on a border when no triangle walks it in the opposite direction
+        std::unordered_set<uint64_t> edges;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                uint64_t from = group[indices[i + e]], to = group[indices[i + (e + 1) % 3]];
+                edges.insert(from << 32 | to);
+            }
+        }
+        std::vector<unsigned char> borderGroup(positions.size(), 0);
+        for (uint64_t edge : edges)
+        {
+            if (!edges.count(edge << 32 | edge >> 32))
+            {
+                borderGroup[edge >> 32] = 1;
+                borderGroup[edge & 0xffffffffu] = 1;
+            }
+        }
+
+        std::vector<unsigned char> locked(positions.size());
+        for (size_t v = 0; v < positions.size(); v++)
+            locked[v] = groupSize[group[v]] > 1 || borderGroup[group[v]];
+        return locked;
+    }
+
+    // collapses edges of `indices` in order of increasing error until `targetCount` indices are left or the next
+    // collapse would exceed `maxError`. returns the largest error of the collapses made.
+    inline float Simplify(const std::vector<glm::vec3> &positions, const std::vector<unsigned char> &locked,
+                          std::vector<Quadric> &quadrics, std::vector<unsigned int> &indices, size_t targetCount,
+                          float maxError)
+    {
+        struct Collapse {
+            unsigned int from, to;
+            double error;
+        };
+        const size_t vertexCount = positions.size();
+        const double errorLimit = (double) maxError * maxError;
+        double largestError = 0.0;
+        std::vector<unsigned int> adjacencyStart(vertexCount + 1), adjacency;
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<unsigned int> remap(vertexCount);
+        std::vector<Collapse> collapses;
+
+        // every pass makes independent collapses (no two share a triangle), then rewrites the index buffer
+        while (indices.size() > targetCount)
+        {
+            // triangles around each vertex
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+            for (unsigned int index : indices)
+                adjacencyStart[index + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                adjacencyStart[v + 1] += adjacencyStart[v];
+            adjacency.resize(indices.size());
+            std::vector<unsigned int> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[cursor[indices[i]]++] = (unsigned int) (i / 3);
+
+            // both directions of every edge once (interior edges are seen from both of their triangles)
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+                    if (a >= b)
+                        continue;
+                    Quadric q = quadrics[a];
+                    q += quadrics[b];
+                    if (!locked[a])
+                        collapses.push_back(Collapse{a, b, q.Error(positions[b])});
+                    if (!locked[b])
+                        collapses.push_back(Collapse{b, a, q.Error(positions[a])});
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+                return x.error < y.error;
+            });
+
+            for (size_t v = 0; v < vertexCount; v++)
+                remap[v] = (unsigned int) v;
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t toRemove = (indices.size() - targetCount) / 3, removed = 0, collapsed = 0;
+            for (const Collapse &collapse : collapses)
+            {
+                if (removed >= toRemove || collapse.error > errorLimit)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+                // moving `from` must not flip (or flatten) any triangle that survives the collapse
+                bool flips = false;
+                size_t dropped = 0;
+                for (unsigned int t = adjacencyStart[collapse.from]; t < adjacencyStart[collapse.from + 1] && !flips; t++)
+                {
+                    const unsigned int* triangle = &indices[adjacency[t] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    {
+                        dropped++;
+                        continue;
+                    }
+                    glm::vec3 p[3], q[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        p[k] = positions[triangle[k]];
+                        q[k] = triangle[k] == collapse.from ? positions[collapse.to] : p[k];
+                    }
+                    glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                    flips = glm::dot(before, after) <= 0.0f;
+                }
+                if (flips)
+                    continue;
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                largestError = std::max(largestError, collapse.error);
+                // the whole one-ring stays fixed for the rest of the pass, so the checks above remain valid
+                for (unsigned int t = adjacencyStart[collapse.from]; t < adjacencyStart[collapse.from + 1]; t++)
+                {
+                    const unsigned int* triangle = &indices[adjacency[t] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                }
+                removed += dropped;
+                collapsed++;
+            }
+            if (collapsed == 0)
+                break;
+
+            size_t write = 0;
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+        }
+        return (float) std::sqrt(largestError);
+    }
+
+    // appends the simplified levels to `indices` and returns the ranges of all levels, the original mesh first.
+    // `radius` is the mesh's bounding radius and scales the error limit.
+    template<typename Vertex>
+    std::vector<MeshLod> Build(const std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, float radius)
+    {
+        std::vector<MeshLod> lods(1);
+        lods[0].count = (unsigned int) indices.size();
+        if (indices.size() / 3 < 2 * MIN_TRIANGLES)
+            return lods;
+
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            positions[v] = vertices[v].Position;
+        std::vector<unsigned char> locked = LockedVertices(positions, indices);
+        // quadrics of the original triangles, carried through all levels so errors stay relative to the original
+        std::vector<Quadric> quadrics(vertices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            Quadric q = Quadric::FromTriangle(positions[indices[i]], positions[indices[i + 1]], positions[indices[i + 2]]);
+            for (int k = 0; k < 3; k++)
+                quadrics[indices[i + k]] += q;
+        }
+
+        std::vector<unsigned int> level(indices);
+        float error = 0.0f;
+        for (int l = 1; l < MAX_LEVELS; l++)
+        {
+            size_t previousCount = level.size();
+            size_t targetCount = (size_t) (previousCount / 3 * LEVEL_RATIO) * 3;
+            if (targetCount / 3 < MIN_TRIANGLES)
+                break;
+            error = std::max(error, Simplify(positions, locked, quadrics, level, targetCount, radius * MAX_RELATIVE_ERROR));
+            // not worth an extra level when the error limit or the locked vertices stopped the simplification early
+            if (level.size() * 10 > previousCount * 9)
+                break;
+            MeshLod lod;
+            lod.first = (unsigned int) indices.size();
+            lod.count = (unsigned int) level.size();
+            lod.error = error;
+            indices.insert(indices.end(), level.begin(), level.end());
+            lods.push_back(lod);
+        }
+        return lods;
+    }
+
+    // coarsest level whose error projects to at most `maxPixelError` pixels. `pixelsPerUnit` is the size in pixels of
+    // one model unit where the mesh is drawn; a negative value selects the original mesh.
+    inline unsigned int Select(const std::vector<MeshLod> &lods, float pixelsPerUnit, float maxPixelError)
+    {
+        if (pixelsPerUnit < 0.0f)
+            return 0;
+        for (size_t l = lods.size() - 1; l > 0; l--)
+        {
+            if (lods[l].error * pixelsPerUnit <= maxPixelError)
+                return (unsigned int) l;
+        }
+        return 0;
+    }
+}
+#endif
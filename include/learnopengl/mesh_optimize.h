@@ -0,0 +1,163 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// import-time reordering of index and vertex buffers for the GPU's vertex caches. runs once per mesh before it goes
+// into the mesh cache, so loading and drawing pay nothing for it.
+namespace MeshOptimize {
+
+    // modelled post-transform cache, in vertices; 32 is a sensible middle for current hardware and degrades gracefully
+    // on smaller caches
+    const int CACHE_SIZE = 32;
+
+    // Forsyth's vertex score: recently used vertices score high (except the last triangle's, to avoid strips that
+    // immediately re-use a whole triangle), vertices with few triangles left score high so they get finished off
+    inline float VertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (float) (cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+        }
+        return score + 2.0f / std::sqrt((float) remainingTriangles);
+    }
+
+    // reorders the triangles of indices[0, count) for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex
+    // Cache Optimisation"). `vertexCount` bounds the index values.
+    inline void OptimizeVertexCache(unsigned int* indices, size_t count, size_t vertexCount)
+    {
+        const size_t triangleCount = count / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles around each vertex; the first remaining[v] entries of a vertex are the ones not yet emitted
+        std::vector<unsigned int> remaining(vertexCount, 0), adjacencyStart(vertexCount + 1, 0);
+        for (size_t i = 0; i < count; i++)
+            remaining[indices[i]]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+        std::vector<unsigned int> adjacency(count), cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+            adjacency[cursor[indices[i]]++] = (unsigned int) (i / 3);
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = VertexScore(-1, remaining[v]);
+        std::vector<float> triangleScore(triangleCount);
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        size_t best = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const unsigned int* triangle = &indices[t * 3];
+            triangleScore[t] = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+            if (triangleScore[t] > triangleScore[best])
+                best = t;
+        }
+
+        std::vector<unsigned int> output;
+        output.reserve(count);
+        std::vector<unsigned int> cache, nextCache;
+        size_t scan = 0;
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+        {
+            const unsigned int* triangle = &indices[best * 3];
+            output.insert(output.end(), triangle, triangle + 3);
+            emitted[best] = 1;
+
+            // drop the triangle from its vertices' remaining lists
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int v = triangle[k];
+                unsigned int* list = &adjacency[adjacencyStart[v]];
+                for (unsigned int j = 0; j < remaining[v]; j++)
+                {
+                    if (list[j] == best)
+                    {
+                        list[j] = list[remaining[v] - 1];
+                        break;
+                    }
+                }
+                remaining[v]--;
+            }
+
+            // the triangle's vertices move to the front of the LRU cache
+            nextCache.assign(triangle, triangle + 3);
+            for (unsigned int v : cache)
+            {
+                if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                    nextCache.push_back(v);
+            }
+            for (size_t i = CACHE_SIZE; i < nextCache.size(); i++)
+            {
+                cachePosition[nextCache[i]] = -1;
+                vertexScore[nextCache[i]] = VertexScore(-1, remaining[nextCache[i]]);
+            }
+            if (nextCache.size() > (size_t) CACHE_SIZE)
+                nextCache.resize(CACHE_SIZE);
+            cache.swap(nextCache);
+            for (size_t i = 0; i < cache.size(); i++)
+            {
+                cachePosition[cache[i]] = (int) i;
+                vertexScore[cache[i]] = VertexScore((int) i, remaining[cache[i]]);
+            }
+
+            // only triangles touching the cache changed score, the next one is picked among them
+            float bestScore = -1.0f;
+            for (unsigned int v : cache)
+            {
+                for (unsigned int j = 0; j < remaining[v]; j++)
+                {
+                    unsigned int t = adjacency[adjacencyStart[v] + j];
+                    const unsigned int* candidate = &indices[t * 3];
+                    triangleScore[t] = vertexScore[candidate[0]] + vertexScore[candidate[1]] + vertexScore[candidate[2]];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+            // nothing connected to the cache is left: continue with the next triangle not emitted yet
+            if (bestScore < 0.0f)
+            {
+                while (scan < triangleCount && emitted[scan])
+                    scan++;
+                best = scan;
+            }
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    // renumbers the vertices in the order the index buffer first uses them, so vertex fetches walk the buffer forwards.
+    // vertices no index refers to are dropped.
+    template<typename Vertex>
+    void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+    {
+        const unsigned int unused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int &index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = (unsigned int) reordered.size();
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+}
+#endif
@@ -11,13 +11,20 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimize.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_loader.h>
+#include <learnopengl/trace.h>
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <atomic>
 #include <vector>
 using namespace std;
 
@@ -25,6 +32,22 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 
 
 
+// load progress of a Model. Blocking models are Ready (or Failed) as soon as the constructor returns; Async models
+// draw a placeholder while Loading and switch to the real meshes once Update() reports Ready.
+enum class LoadState { Loading, Ready, Failed };
+enum class LoadMode { Blocking, Async };
+// where a model's diffuse maps are sampled from: 2D textures bound per mesh, or only layers of a MaterialTable's arrays.
+// for ArrayLayers the 2D texture name is reserved to identify the material but the image is never decoded into it.
+enum class DiffuseMaps { Texture2D, ArrayLayers };
+
+// CPU import result (from the mesh cache or Assimp) shared by every Model created from the same file.
+// written by whichever thread runs the import and published through `done`.
+struct ImportedAsset {
+    atomic<bool> done{false};
+    bool ok = false;
+    vector<MeshData> meshes;
+};
+
 class Model
 {
 public:
@@ -40,6 +63,22 @@ public:
         loadModel(path);
     }
 
+    // with LoadMode::Async the file is imported on the thread pool and the model draws a shared low-poly placeholder
+    // sphere until Update() swaps in the real meshes.
+    Model(string const &path, LoadMode mode, DiffuseMaps diffuseMaps = DiffuseMaps::Texture2D, bool gamma = false)
+            : gammaCorrection(gamma), diffuseMaps(diffuseMaps)
+    {
+        TRACE_SCOPE_DETAIL("Model", path);
+        if (mode == LoadMode::Blocking)
+        {
+            loadModel(path);
+            return;
+        }
+        directory = path.substr(0, path.find_last_of('/'));
+        asset = importAsset(path, true);
+        meshes.push_back(placeholderMesh());
+    }
+
     // draws the model, and thus all its meshes
     void Draw(Shader &shader)
     {
@@ -47,33 +86,217 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws every mesh at the coarsest level whose error stays under `maxPixelError` pixels, `pixelsPerUnit` being the
+    // on-screen size of one model unit (see MeshLodBuilder::Select)
+    void Draw(Shader &shader, float pixelsPerUnit, float maxPixelError)
+    {
+        for (Mesh &mesh : meshes)
+            mesh.Draw(shader, MeshLodBuilder::Select(mesh.lods, pixelsPerUnit, maxPixelError));
+    }
+
     void SetShaderTextureNamePrefix(std::string prefix) {
+        shaderTextureNamePrefix = prefix;
         for (Mesh& mesh: meshes) {
             mesh.glslIdentifierPrefix = prefix;
         }
     }
+
+    LoadState GetLoadState() const
+    {
+        return loadState;
+    }
+
+    // model space bounding sphere of what Draw currently draws: the placeholder's unit sphere until the model is Ready
+    const BoundingSphere &Bounds() const
+    {
+        return bounds;
+    }
+
+    // advances an async load; call once per frame on the GL thread. the real meshes replace the placeholder only once
+    // their geometry is uploaded and all their textures are, so a model never shows up half textured.
+    // returns true when the model is Ready.
+    bool Update()
+    {
+        if (loadState != LoadState::Loading)
+            return loadState == LoadState::Ready;
+
+        if (!meshesCreated)
+        {
+            if (!asset->done.load(std::memory_order_acquire))
+                return false;
+            if (!asset->ok)
+            {
+                loadState = LoadState::Failed;
+                return false;
+            }
+            for (const MeshData& data : asset->meshes)
+                streamedMeshes.push_back(createMesh(data));
+            for (Mesh& mesh : streamedMeshes)
+                mesh.glslIdentifierPrefix = shaderTextureNamePrefix;
+            meshesCreated = true;
+        }
+
+        for (const Texture& texture : textures_loaded)
+        {
+            if (!TextureLoader::Instance().IsUploaded(texture.id))
+                return false;
+        }
+        meshes.swap(streamedMeshes);
+        streamedMeshes.clear();
+        bounds = assetBounds(*asset);
+        loadState = LoadState::Ready;
+        return true;
+    }
+
 private:
+    LoadState loadState = LoadState::Loading;
+    DiffuseMaps diffuseMaps = DiffuseMaps::Texture2D;
+    string shaderTextureNamePrefix;
+    shared_ptr<ImportedAsset> asset;
+    // async only: real meshes created but still waiting for their textures
+    vector<Mesh> streamedMeshes;
+    bool meshesCreated = false;
+    BoundingSphere bounds = placeholderBounds();
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        TRACE_SCOPE_DETAIL("loadModel", path);
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        asset = importAsset(path, false);
+        if (!asset->ok)
+        {
+            loadState = LoadState::Failed;
+            return;
+        }
+        for (const MeshData& data : asset->meshes)
+            meshes.push_back(createMesh(data));
+        meshesCreated = true;
+        bounds = assetBounds(*asset);
+        loadState = LoadState::Ready;
+    }
+
+    // returns the import of `path`, starting it if this is the first model using the file (e.g. earth.obj for both the
+    // planet and its atmosphere is parsed once). async imports run on the thread pool, blocking ones inline; a blocking
+    // request for a file that is still being imported in the background waits for it.
+    static shared_ptr<ImportedAsset> importAsset(string const &path, bool async)
+    {
+        static map<string, shared_ptr<ImportedAsset>> importedAssets;
+        shared_ptr<ImportedAsset> &asset = importedAssets[path];
+        if (!asset)
+        {
+            asset = make_shared<ImportedAsset>();
+            shared_ptr<ImportedAsset> job = asset;
+            auto import = [job, path]() {
+                job->ok = importFile(path, job->meshes);
+                job->done.store(true, std::memory_order_release);
+            };
+            if (async)
+                ThreadPool::Instance().Submit(import);
+            else
+                import();
+        }
+        while (!async && !asset->done.load(std::memory_order_acquire))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return asset;
+    }
+
+    // CPU-only import, safe to run on a worker thread.
+    static bool importFile(string const &path, vector<MeshData> &meshData)
+    {
+        TRACE_SCOPE_DETAIL("importFile", path);
+        // warm start: the baked cache next to the asset skips Assimp entirely
+        {
+            TRACE_SCOPE("MeshCache::Load");
+            if (MeshCache::Load(path, meshData))
+                return true;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene;
+        {
+            TRACE_SCOPE("Assimp::ReadFile");
+            scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        }
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, meshData);
+        MeshCache::Store(path, meshData);
+        return true;
+    }
+
+    static BoundingSphere placeholderBounds()
+    {
+        BoundingSphere sphere;
+        sphere.radius = 1.0f;
+        return sphere;
+    }
+
+    static BoundingSphere assetBounds(const ImportedAsset &imported)
+    {
+        BoundingSphere sphere;
+        for (const MeshData &data : imported.meshes)
+            sphere = BoundingSphere::Merge(sphere, data.bounds);
+        return sphere;
+    }
+
+    // low-poly unit sphere with a flat grey texture, shared by every model that is still loading
+    static Mesh placeholderMesh()
+    {
+        static Mesh placeholder = []() {
+            const unsigned int stacks = 8, slices = 16;
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            for (unsigned int i = 0; i <= stacks; i++)
+            {
+                float phi = glm::radians(180.0f) * i / stacks;
+                for (unsigned int j = 0; j <= slices; j++)
+                {
+                    float theta = glm::radians(360.0f) * j / slices;
+                    Vertex vertex;
+                    vertex.Position = glm::vec3(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+                    vertex.Normal = vertex.Position;
+                    vertex.TexCoords = glm::vec2((float) j / slices, (float) i / stacks);
+                    vertex.Tangent = glm::vec3(-sin(theta), 0.0f, cos(theta));
+                    vertex.Bitangent = glm::cross(vertex.Normal, vertex.Tangent);
+                    vertices.push_back(vertex);
+                }
+            }
+            for (unsigned int i = 0; i < stacks; i++)
+            {
+                for (unsigned int j = 0; j < slices; j++)
+                {
+                    unsigned int first = i * (slices + 1) + j;
+                    unsigned int second = first + slices + 1;
+                    indices.insert(indices.end(), {first, first + 1, second, second, first + 1, second + 1});
+                }
+            }
+
+            Texture texture;
+            glGenTextures(1, &texture.id);
+            const unsigned char grey[4] = {128, 128, 128, 255};
+            GLStateCache::Instance().BindTexture(0, GL_TEXTURE_2D, texture.id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            texture.type = "texture_diffuse";
+            texture.path = "<placeholder>";
+            return Mesh(vertices, indices, vector<Texture>{texture});
+        }();
+        return placeholder;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &meshData)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -81,27 +304,32 @@ private:
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            meshData.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, meshData);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
+        TRACE_SCOPE("processMesh");
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<unsigned int> &indices = data.indices;
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
+            // attributes the file doesn't provide are zeroed so identical geometry always hashes identically
             Vertex vertex;
+            vertex.Normal = glm::vec3(0.0f);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
             glm::vec3 vector; // we declare a placeholder vector since assimp_ uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -164,96 +392,84 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        collectMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        collectMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+        collectMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", data.textures);
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
+        collectMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", data.textures);
 
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // culling bounds and the LOD chain, baked into the mesh cache with the rest
+        data.bounds = BoundingSphere::FromVertices(vertices);
+        {
+            TRACE_SCOPE("MeshLodBuilder::Build");
+            data.lods = MeshLodBuilder::Build(vertices, indices, data.bounds.radius);
+        }
+        // every level ordered for the post-transform cache, then the vertices in the order the levels use them
+        {
+            TRACE_SCOPE("MeshOptimize");
+            for (const MeshLod &lod : data.lods)
+            {
+                if (lod.count > 0)
+                    MeshOptimize::OptimizeVertexCache(&indices[lod.first], lod.count, vertices.size());
+            }
+            MeshOptimize::OptimizeVertexFetch(vertices, indices);
+        }
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // records the paths of all material textures of a given type; they are loaded in createMesh.
+    static void collectMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<pair<string, string>> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(make_pair(typeName, string(str.C_Str())));
         }
-        return textures;
+    }
+
+    // uploads baked mesh data (from Assimp or from the cache) and resolves its textures
+    Mesh createMesh(const MeshData &data)
+    {
+        TRACE_SCOPE("createMesh");
+        vector<Texture> textures;
+        for (const auto &texture : data.textures)
+            textures.push_back(loadMaterialTexture(texture.second, texture.first));
+        return Mesh(data.vertices, data.indices, textures, data.lods);
+    }
+
+    // loads the texture if it's not loaded yet. the required info is returned as a Texture struct.
+    Texture loadMaterialTexture(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        Texture texture;
+        if (typeName == "texture_diffuse" && diffuseMaps == DiffuseMaps::ArrayLayers)
+            texture.id = TextureLoader::Instance().Reserve2D(this->directory + '/' + path);
+        else
+            texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
 
+// returns the texture name immediately; the image itself is decoded on the thread pool and uploaded by
+// TextureLoader::ProcessUploads/Finish on the GL thread.
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
+    TRACE_SCOPE_DETAIL("TextureFromFile", path);
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureLoader::Instance().Load2D(filename);
 }
 #endif
@@ -0,0 +1,80 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define NORMAL_MATRIX_SSE 1
+#endif
+
+// normal matrices, transpose(inverse(mat3(model))), computed on the CPU once per body and frame instead of once per
+// vertex in the vertex shader. with the upper 3x3 as columns a, b, c the result has the columns b x c, c x a and a x b,
+// divided by the determinant a . (b x c). singular matrices (zero scale) get their cofactors unscaled.
+
+inline glm::mat3 NormalMatrix(const glm::mat4 &model)
+{
+    glm::vec3 a(model[0]), b(model[1]), c(model[2]);
+    glm::vec3 bc = glm::cross(b, c), ca = glm::cross(c, a), ab = glm::cross(a, b);
+    float determinant = glm::dot(a, bc);
+    float scale = std::fabs(determinant) > 1e-30f ? 1.0f / determinant : 1.0f;
+    return glm::mat3(bc * scale, ca * scale, ab * scale);
+}
+
+// normal matrices of `count` model matrices. four matrices per iteration with SSE: their columns are transposed so each
+// register holds one matrix element of all four; the remainder, or everything without SSE, takes the scalar path.
+inline void NormalMatrices(const glm::mat4* models, size_t count, glm::mat3* normals)
+{
+    size_t i = 0;
+#ifdef NORMAL_MATRIX_SSE
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), tiny = _mm_set1_ps(1e-30f);
+    for (; i + 4 <= count; i += 4)
+    {
+        // m[column][row], lanes are the four matrices
+        __m128 m[3][4];
+        for (int column = 0; column < 3; column++)
+        {
+            for (int k = 0; k < 4; k++)
+                m[column][k] = _mm_loadu_ps(&models[i + k][column][0]);
+            _MM_TRANSPOSE4_PS(m[column][0], m[column][1], m[column][2], m[column][3]);
+        }
+        __m128 (&a)[4] = m[0], (&b)[4] = m[1], (&c)[4] = m[2];
+        auto cross = [](const __m128* u, const __m128* v, __m128* out) {
+            out[0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+            out[1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+            out[2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+        };
+        __m128 result[3][4];
+        cross(b, c, result[0]);
+        cross(c, a, result[1]);
+        cross(a, b, result[2]);
+        __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], result[0][0]), _mm_mul_ps(a[1], result[0][1])),
+                                        _mm_mul_ps(a[2], result[0][2]));
+        __m128 magnitude = _mm_max_ps(determinant, _mm_sub_ps(zero, determinant));
+        __m128 regular = _mm_cmpgt_ps(magnitude, tiny);
+        __m128 scale = _mm_or_ps(_mm_and_ps(regular, _mm_div_ps(one, determinant)), _mm_andnot_ps(regular, one));
+
+        for (int column = 0; column < 3; column++)
+        {
+            for (int row = 0; row < 3; row++)
+                result[column][row] = _mm_mul_ps(result[column][row], scale);
+            result[column][3] = zero;
+            _MM_TRANSPOSE4_PS(result[column][0], result[column][1], result[column][2], result[column][3]);
+            // back to one register per matrix; mat3 columns are 3 floats, so only 12 of the 16 bytes are stored
+            for (int k = 0; k < 4; k++)
+            {
+                float lanes[4];
+                _mm_storeu_ps(lanes, result[column][k]);
+                memcpy(&normals[i + k][column][0], lanes, 3 * sizeof(float));
+            }
+        }
+    }
+#endif
+    for (; i < count; i++)
+        normals[i] = NormalMatrix(models[i]);
+}
+#endif
@@ -0,0 +1,284 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/trace.h>
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// scoped CPU/GPU profiler for the passes of a frame. CPU times come from std::chrono, GPU times from GL_TIMESTAMP
+// queries written at scope begin and end. results are read LATENCY frames later; when the GPU hasn't finished a frame
+// by then its GPU times are dropped instead of waiting, so profiling never stalls the pipeline.
+// usage, once per frame on the GL thread:
+//     Profiler::Instance().BeginFrame();
+//     { PROFILE_SCOPE("planets"); ... }
+//     Profiler::Instance().EndFrame();
+class Profiler
+{
+public:
+    // frames kept for the overlay graphs and the exports
+    static const int HISTORY = 240;
+
+    // one timed scope of a finished frame, times in milliseconds since the profiler started
+    struct Sample {
+        int name;           // index into Names()
+        int depth;
+        double cpuStart, cpuEnd;
+        double gpuStart, gpuEnd;    // negative when the GPU result was dropped
+    };
+
+    struct Frame {
+        long long index;
+        std::vector<Sample> samples;
+    };
+
+    static Profiler &Instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    bool enabled = true;
+
+    void BeginFrame()
+    {
+        if (!enabled)
+            return;
+        if (!initialized)
+            initialize();
+        PendingFrame &pending = slots[frameIndex % LATENCY];
+        if (pending.index >= 0)
+            resolve(pending);
+        pending.index = frameIndex;
+        pending.samples.clear();
+        pending.queriesUsed = 0;
+        current = &pending;
+    }
+
+    void EndFrame()
+    {
+        if (!current)
+            return;
+        current = nullptr;
+        frameIndex++;
+    }
+
+    void BeginScope(const char* name)
+    {
+        if (!current)
+            return;
+        PendingSample sample;
+        sample.name = nameIndex(name);
+        sample.depth = (int) openScopes.size();
+        sample.cpuStart = cpuNow();
+        sample.gpuStartQuery = query(*current);
+        glQueryCounter(current->queries[sample.gpuStartQuery], GL_TIMESTAMP);
+        openScopes.push_back(current->samples.size());
+        current->samples.push_back(sample);
+    }
+
+    void EndScope()
+    {
+        if (!current || openScopes.empty())
+            return;
+        PendingSample &sample = current->samples[openScopes.back()];
+        openScopes.pop_back();
+        sample.cpuEnd = cpuNow();
+        sample.gpuEndQuery = query(*current);
+        glQueryCounter(current->queries[sample.gpuEndQuery], GL_TIMESTAMP);
+    }
+
+    const std::vector<std::string> &Names() const
+    {
+        return names;
+    }
+
+    // resolved frames, oldest first
+    const std::deque<Frame> &History() const
+    {
+        return history;
+    }
+
+    // one line per sample: frame, scope, depth, CPU start, CPU and GPU duration (ms)
+    bool ExportCsv(const std::string &filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER:: cannot write " << filename << std::endl;
+            return false;
+        }
+        fprintf(file, "frame,scope,depth,cpu_start_ms,cpu_ms,gpu_ms\n");
+        for (const Frame &frame : history)
+        {
+            for (const Sample &sample : frame.samples)
+            {
+                fprintf(file, "%lld,%s,%d,%.4f,%.4f,", frame.index, names[sample.name].c_str(), sample.depth,
+                        sample.cpuStart, sample.cpuEnd - sample.cpuStart);
+                if (sample.gpuStart >= 0.0)
+                    fprintf(file, "%.4f", sample.gpuEnd - sample.gpuStart);
+                fprintf(file, "\n");
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+    // Chrome trace event format (chrome://tracing, Perfetto): CPU scopes on thread 1, GPU scopes on thread 2
+    bool ExportChromeTrace(const std::string &filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER:: cannot write " << filename << std::endl;
+            return false;
+        }
+        fprintf(file, "{\"traceEvents\": [\n");
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n");
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}");
+        for (const Frame &frame : history)
+        {
+            for (const Sample &sample : frame.samples)
+            {
+                fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}",
+                        names[sample.name].c_str(), sample.cpuStart * 1000.0, (sample.cpuEnd - sample.cpuStart) * 1000.0);
+                if (sample.gpuStart >= 0.0)
+                    fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 1, \"tid\": 2, \"ts\": %.3f, \"dur\": %.3f}",
+                            names[sample.name].c_str(), sample.gpuStart * 1000.0, (sample.gpuEnd - sample.gpuStart) * 1000.0);
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    static const int LATENCY = 3;
+
+    struct PendingSample {
+        int name, depth;
+        double cpuStart, cpuEnd;
+        int gpuStartQuery, gpuEndQuery;
+    };
+
+    struct PendingFrame {
+        long long index = -1;
+        std::vector<PendingSample> samples;
+        std::vector<unsigned int> queries;
+        size_t queriesUsed = 0;
+    };
+
+    bool initialized = false;
+    long long frameIndex = 0;
+    PendingFrame slots[LATENCY];
+    PendingFrame* current = nullptr;
+    std::vector<size_t> openScopes;
+    std::vector<std::string> names;
+    std::deque<Frame> history;
+    std::chrono::steady_clock::time_point start;
+    // added to GPU timestamps (ms) to put them on the CPU timeline
+    double gpuOffset = 0.0;
+
+    Profiler() = default;
+
+    void initialize()
+    {
+        initialized = true;
+        start = std::chrono::steady_clock::now();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuOffset = -gpuNow / 1.0e6;
+    }
+
+    double cpuNow() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int nameIndex(const char* name)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+                return (int) i;
+        }
+        names.push_back(name);
+        return (int) names.size() - 1;
+    }
+
+    int query(PendingFrame &frame)
+    {
+        if (frame.queriesUsed == frame.queries.size())
+        {
+            unsigned int id;
+            glGenQueries(1, &id);
+            frame.queries.push_back(id);
+        }
+        return (int) frame.queriesUsed++;
+    }
+
+    void resolve(PendingFrame &pending)
+    {
+        // queries complete in order, so the last one being available means all of them are
+        GLint available = 1;
+        if (pending.queriesUsed > 0)
+            glGetQueryObjectiv(pending.queries[pending.queriesUsed - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        Frame frame;
+        frame.index = pending.index;
+        for (const PendingSample &pendingSample : pending.samples)
+        {
+            Sample sample;
+            sample.name = pendingSample.name;
+            sample.depth = pendingSample.depth;
+            sample.cpuStart = pendingSample.cpuStart;
+            sample.cpuEnd = pendingSample.cpuEnd;
+            sample.gpuStart = sample.gpuEnd = -1.0;
+            if (available)
+            {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(pending.queries[pendingSample.gpuStartQuery], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(pending.queries[pendingSample.gpuEndQuery], GL_QUERY_RESULT, &end);
+                sample.gpuStart = begin / 1.0e6 + gpuOffset;
+                sample.gpuEnd = end / 1.0e6 + gpuOffset;
+            }
+            frame.samples.push_back(sample);
+        }
+        history.push_back(std::move(frame));
+        if (history.size() > (size_t) HISTORY)
+            history.pop_front();
+        pending.index = -1;
+    }
+};
+
+// times the enclosing block, and records it in the trace when tracing
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : trace(name)
+    {
+        Profiler::Instance().BeginScope(name);
+    }
+
+    ~ProfileScope()
+    {
+        Profiler::Instance().EndScope();
+    }
+
+private:
+    TraceScope trace;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#endif
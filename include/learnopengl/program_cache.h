@@ -0,0 +1,184 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+#include <learnopengl/gl_extensions.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// linked programs saved with glGetProgramBinary and restored with glProgramBinary, so a warm start compiles no GLSL.
+// one file per program, <Directory()>/<key>.progbin, where the key is an FNV-1a hash of the final stage sources (after
+// #define injection) and of the driver's vendor, renderer and version strings. a driver update therefore misses instead
+// of loading a stale binary; drivers may still reject a binary they wrote themselves, which Load reports as a miss.
+// layout (native endianness): header | binary
+namespace ProgramCache {
+
+    const uint32_t MAGIC = 0x42504752; // "RGPB"
+    // bump whenever the container layout changes
+    const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+    };
+
+    // cleared by --no-program-cache
+    inline bool &Enabled()
+    {
+        static bool enabled = true;
+        return enabled;
+    }
+
+    inline std::string &Directory()
+    {
+        static std::string directory = "shadercache";
+        return directory;
+    }
+
+    // programs restored from the cache and programs compiled from source since startup
+    inline unsigned int &Hits()
+    {
+        static unsigned int hits = 0;
+        return hits;
+    }
+
+    inline unsigned int &Misses()
+    {
+        static unsigned int misses = 0;
+        return misses;
+    }
+
+    // enabled, and the context can save and restore program binaries
+    inline bool Available()
+    {
+        return Enabled() && GLExtensions::GetProgramBinary() && GLExtensions::ProgramBinary() &&
+               GLExtensions::ProgramParameteri();
+    }
+
+    inline void hash(uint64_t& key, const char* data, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            key ^= (unsigned char) data[i];
+            key *= 1099511628211ULL;
+        }
+        // separator, so ("ab", "c") and ("a", "bc") differ
+        key ^= 0xff;
+        key *= 1099511628211ULL;
+    }
+
+    // identifies a program built from `sources` by the current driver. must be called with a current context.
+    inline uint64_t Key(const std::vector<const std::string*>& sources)
+    {
+        uint64_t key = 14695981039346656037ULL;
+        for (const std::string* source : sources)
+            hash(key, source->data(), source->size());
+        const GLenum strings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for (GLenum name : strings)
+        {
+            const char* value = (const char*) glGetString(name);
+            std::string driver = value ? value : "";
+            hash(key, driver.data(), driver.size());
+        }
+        return key;
+    }
+
+    inline std::string CachePath(uint64_t key)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.progbin", (unsigned long long) key);
+        return Directory() + "/" + name;
+    }
+
+    // links `program` from the cached binary. false, with `program` left unlinked, when there is no usable entry.
+    inline bool Load(GLuint program, uint64_t key)
+    {
+        if (!Available())
+            return false;
+        FILE* file = fopen(CachePath(key).c_str(), "rb");
+        if (!file)
+            return false;
+
+        Header header;
+        std::vector<char> binary;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                     header.magic == MAGIC && header.version == VERSION && header.key == key && header.binaryLength > 0;
+        if (valid)
+        {
+            binary.resize(header.binaryLength);
+            valid = fread(&binary[0], binary.size(), 1, file) == 1;
+        }
+        fclose(file);
+        if (!valid)
+            return false;
+
+        GLExtensions::ProgramBinary()(program, header.binaryFormat, &binary[0], (GLsizei) binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE)
+        {
+            std::cout << "WARNING::PROGRAM_CACHE:: driver rejected " << CachePath(key) << ", recompiling" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // asks the driver to keep the binary of `program` retrievable; call between attaching the stages and linking
+    inline void PrepareLink(GLuint program)
+    {
+        if (Available())
+            GLExtensions::ProgramParameteri()(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // saves the binary of the linked `program`. goes through a temporary file so a crash never leaves a truncated entry.
+    inline void Store(GLuint program, uint64_t key)
+    {
+        if (!Available())
+            return;
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (linked != GL_TRUE || length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLsizei written = 0;
+        GLenum format = 0;
+        GLExtensions::GetProgramBinary()(program, length, &written, &format, &binary[0]);
+        if (written <= 0)
+            return;
+
+        // an existing directory makes mkdir fail, which is fine
+        mkdir(Directory().c_str(), 0755);
+        std::string path = CachePath(key);
+        std::string tmpPath = path + ".tmp";
+        FILE* file = fopen(tmpPath.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "WARNING::PROGRAM_CACHE:: cannot write " << path << std::endl;
+            return;
+        }
+        Header header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binaryLength = (uint32_t) written;
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(&binary[0], written, 1, file);
+        bool ok = ferror(file) == 0;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+            remove(tmpPath.c_str());
+    }
+}
+#endif
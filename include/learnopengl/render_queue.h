@@ -0,0 +1,89 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <learnopengl/gl_state_cache.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// passes run in this order: opaque geometry, then the skybox behind it, then transparent geometry over both
+enum class RenderPass : uint64_t {
+    Opaque = 0,
+    Sky = 1,
+    Transparent = 2
+};
+
+// one draw of the frame. the queue applies `state` and binds `program`; `draw` sets the packet's uniforms, binds its
+// VAO and textures through GLStateCache::Instance() and issues the draw call.
+struct RenderPacket {
+    uint64_t key;
+    RenderState state;
+    unsigned int program;
+    std::function<void()> draw;
+};
+
+// packets are collected in any order, then sorted by their 64 bit key and executed with redundant state changes
+// dropped. every frame: Clear, Add each packet, Execute.
+//   opaque and sky   pass:4 | program:12 | material:24 | depth:24     state changes first, front to back within them
+//   transparent      pass:4 | far depth:24 | program:12 | material:24  back to front, as blending needs
+class RenderQueue
+{
+public:
+    // `depth` is the view distance over the far plane, `material` anything that identifies the textures a packet binds
+    static uint64_t MakeKey(RenderPass pass, unsigned int program, unsigned int material, float depth)
+    {
+        uint64_t quantized = (uint64_t) (std::max(0.0f, std::min(1.0f, depth)) * DEPTH_MASK);
+        uint64_t key = (uint64_t) pass << 60;
+        if (pass == RenderPass::Transparent)
+            return key | (DEPTH_MASK - quantized) << 36 | (uint64_t) (program & 0xfff) << 24 | (material & 0xffffff);
+        return key | (uint64_t) (program & 0xfff) << 48 | (uint64_t) (material & 0xffffff) << 24 | quantized;
+    }
+
+    void Clear()
+    {
+        packets.clear();
+    }
+
+    void Add(uint64_t key, const RenderState &state, unsigned int program, std::function<void()> draw)
+    {
+        packets.push_back(RenderPacket{key, state, program, std::move(draw)});
+    }
+
+    // packets with equal keys keep the order they were added in
+    void Execute()
+    {
+        order.clear();
+        for (size_t i = 0; i < packets.size(); i++)
+            order.emplace_back(packets[i].key, (uint32_t) i);
+        std::sort(order.begin(), order.end());
+
+        GLStateCache &cache = GLStateCache::Instance();
+        cache.ResetCounters();
+        for (const auto &entry : order)
+        {
+            const RenderPacket &packet = packets[entry.second];
+            cache.Apply(packet.state);
+            cache.UseProgram(packet.program);
+            packet.draw();
+        }
+        // nothing after the queue writes through a VAO of ours by accident
+        cache.BindVertexArray(0);
+        cache.Apply(RenderState());
+    }
+
+    size_t Count() const
+    {
+        return packets.size();
+    }
+
+private:
+    static const uint64_t DEPTH_MASK = 0xffffff;
+
+    std::vector<RenderPacket> packets;
+    // (key, packet index) pairs, sorted instead of the packets themselves
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+};
+#endif
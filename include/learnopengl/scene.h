@@ -0,0 +1,340 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/bounds.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/normal_matrix.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scene files are plain text, one statement per line, '#' starts a comment. A body is declared by `body` and the
+// statements after it describe that body until the next `body`:
+//
+//   body <name> <model path>
+//   parent <name>                        orbit around an earlier body instead of the origin
+//   orbit <radius> <rate> <height>       circle in the parent's xz plane, rate in radians per second, height above parent
+//   size <scale>
+//   spin <rate> [tilt]                   rotation around y in radians per second, after a tilt around x in degrees
+//   emissive                             drawn unlit with the light source shader
+//   atmosphere <model path> <size> <r> <g> <b> <a>   transparent tinted shell following the body
+//   light <r> <g> <b> <range>            point light at the body's center, fading out to nothing at range
+//
+// see resources/scenes/solar_system.scene
+
+// structure-of-arrays body table: index i of every array belongs to body i. parents always come before their children,
+// so Update resolves the hierarchy in a single pass.
+struct BodyTable {
+    std::vector<std::string> name;
+    std::vector<int> parent;            // -1 for bodies around the origin
+    std::vector<int> model;             // index into Scene::models
+    std::vector<float> orbitRadius;
+    std::vector<float> orbitRate;
+    std::vector<float> orbitHeight;
+    std::vector<float> size;
+    std::vector<float> spinRate;
+    std::vector<float> tilt;            // radians
+    std::vector<unsigned char> emissive;
+    std::vector<int> atmosphereModel;   // -1 without atmosphere
+    std::vector<float> atmosphereSize;
+    std::vector<glm::vec4> atmosphereColor;
+    std::vector<glm::vec3> lightColor;
+    std::vector<float> lightRange;      // 0 without light
+
+    // filled by Update
+    std::vector<glm::vec3> position;
+    std::vector<glm::mat4> transform;
+    std::vector<glm::mat4> atmosphereTransform;
+    // inverse transposes of the transforms above, for the vertex shaders' normals
+    std::vector<glm::mat3> normalMatrix;
+    std::vector<glm::mat3> atmosphereNormalMatrix;
+    // filled by UpdateBounds and Cull: world space bounding spheres and whether they can be on screen
+    SphereSet bounds;
+    SphereSet atmosphereBounds;
+    // filled by UpdateScreenScale: on-screen size in pixels of one model unit, picks the mesh detail level
+    std::vector<float> pixelsPerUnit;
+    std::vector<float> atmospherePixelsPerUnit;
+
+    size_t Count() const
+    {
+        return name.size();
+    }
+
+    // positions and model matrices of every body at `time` seconds
+    void Update(float time)
+    {
+        const size_t count = Count();
+        for (size_t i = 0; i < count; i++)
+        {
+            float angle = time * orbitRate[i];
+            glm::vec3 center = parent[i] >= 0 ? position[parent[i]] : glm::vec3(0.0f);
+            position[i] = center + glm::vec3(std::sin(angle) * orbitRadius[i], orbitHeight[i], std::cos(angle) * orbitRadius[i]);
+        }
+        // translate * scale * rotate(spin, y) * rotate(tilt, x), written out column by column
+        for (size_t i = 0; i < count; i++)
+        {
+            float spin = time * spinRate[i];
+            float sinSpin = std::sin(spin), cosSpin = std::cos(spin);
+            float sinTilt = std::sin(tilt[i]), cosTilt = std::cos(tilt[i]);
+            float scale = size[i];
+            glm::mat4 &m = transform[i];
+            m[0] = glm::vec4(scale * cosSpin, 0.0f, -scale * sinSpin, 0.0f);
+            m[1] = glm::vec4(scale * sinSpin * sinTilt, scale * cosTilt, scale * cosSpin * sinTilt, 0.0f);
+            m[2] = glm::vec4(scale * sinSpin * cosTilt, -scale * sinTilt, scale * cosSpin * cosTilt, 0.0f);
+            m[3] = glm::vec4(position[i], 1.0f);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            if (atmosphereModel[i] < 0)
+                continue;
+            float scale = atmosphereSize[i];
+            glm::mat4 &m = atmosphereTransform[i];
+            m = glm::mat4(scale);
+            m[3] = glm::vec4(position[i], 1.0f);
+        }
+        if (count > 0)
+        {
+            NormalMatrices(&transform[0], count, &normalMatrix[0]);
+            NormalMatrices(&atmosphereTransform[0], count, &atmosphereNormalMatrix[0]);
+        }
+    }
+
+    // moves the model space bounds of every body's model (indexed like Scene::models) to world space. call after
+    // Update; body scales are uniform, so the radius only scales.
+    void UpdateBounds(const std::vector<BoundingSphere> &modelBounds)
+    {
+        const size_t count = Count();
+        bounds.Resize(count);
+        atmosphereBounds.Resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const BoundingSphere &sphere = modelBounds[model[i]];
+            bounds.Set(i, glm::vec3(transform[i] * glm::vec4(sphere.center, 1.0f)), sphere.radius * size[i]);
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            // bodies without an atmosphere get a sphere no frustum can contain
+            if (atmosphereModel[i] < 0)
+            {
+                atmosphereBounds.Set(i, position[i], -1e30f);
+                continue;
+            }
+            const BoundingSphere &sphere = modelBounds[atmosphereModel[i]];
+            atmosphereBounds.Set(i, glm::vec3(atmosphereTransform[i] * glm::vec4(sphere.center, 1.0f)),
+                                 sphere.radius * atmosphereSize[i]);
+        }
+    }
+
+    void Cull(const Frustum &frustum)
+    {
+        bounds.Cull(frustum);
+        atmosphereBounds.Cull(frustum);
+    }
+
+    // call after UpdateBounds. `projectionScale` is the viewport height over 2 tan(fovy / 2). the distance is taken to
+    // the nearest point of the bounding sphere, so the side facing the camera decides the detail.
+    void UpdateScreenScale(const glm::vec3 &eye, float projectionScale, float nearPlane)
+    {
+        const size_t count = Count();
+        pixelsPerUnit.resize(count);
+        atmospherePixelsPerUnit.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            pixelsPerUnit[i] = size[i] * projectionScale / sphereDistance(bounds, i, eye, nearPlane);
+            atmospherePixelsPerUnit[i] = atmosphereSize[i] * projectionScale / sphereDistance(atmosphereBounds, i, eye, nearPlane);
+        }
+    }
+
+private:
+    static float sphereDistance(const SphereSet &spheres, size_t i, const glm::vec3 &eye, float nearPlane)
+    {
+        glm::vec3 offset = glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]) - eye;
+        return std::max(nearPlane, glm::length(offset) - spheres.radius[i]);
+    }
+};
+
+struct Scene {
+    // unique model paths, referenced by index from the body table
+    std::vector<std::string> models;
+    BodyTable bodies;
+
+    // parses a scene file, see the format above. prints the offending line and returns false on errors.
+    bool LoadFromFile(const std::string &filename)
+    {
+        std::ifstream in(filename);
+        if (!in)
+        {
+            std::cout << "ERROR::SCENE:: cannot open " << filename << std::endl;
+            return false;
+        }
+        models.clear();
+        bodies = BodyTable();
+        std::map<std::string, int> modelIndices, bodyIndices;
+
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(in, line))
+        {
+            lineNumber++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+            std::istringstream words(line);
+            std::string keyword;
+            if (!(words >> keyword))
+                continue;
+
+            bool ok = true;
+            int body = (int) bodies.Count() - 1;
+            if (keyword == "body")
+            {
+                std::string name, path;
+                ok = (bool) (words >> name >> path) && !bodyIndices.count(name);
+                if (ok)
+                {
+                    bodyIndices[name] = (int) bodies.Count();
+                    addBody(name, modelIndex(path, modelIndices));
+                }
+            }
+            else if (body < 0)
+                ok = false;
+            else if (keyword == "parent")
+            {
+                std::string name;
+                ok = (bool) (words >> name) && bodyIndices.count(name) && bodyIndices[name] != body;
+                if (ok)
+                    bodies.parent[body] = bodyIndices[name];
+            }
+            else if (keyword == "orbit")
+                ok = (bool) (words >> bodies.orbitRadius[body] >> bodies.orbitRate[body] >> bodies.orbitHeight[body]);
+            else if (keyword == "size")
+                ok = (bool) (words >> bodies.size[body]);
+            else if (keyword == "spin")
+            {
+                float tiltDegrees = 0.0f;
+                ok = (bool) (words >> bodies.spinRate[body]);
+                if (ok && words >> tiltDegrees)
+                    bodies.tilt[body] = glm::radians(tiltDegrees);
+            }
+            else if (keyword == "emissive")
+                bodies.emissive[body] = 1;
+            else if (keyword == "light")
+            {
+                glm::vec3 &color = bodies.lightColor[body];
+                ok = (bool) (words >> color.r >> color.g >> color.b >> bodies.lightRange[body]) &&
+                     bodies.lightRange[body] > 0.0f;
+            }
+            else if (keyword == "atmosphere")
+            {
+                std::string path;
+                glm::vec4 &color = bodies.atmosphereColor[body];
+                ok = (bool) (words >> path >> bodies.atmosphereSize[body] >> color.r >> color.g >> color.b >> color.a);
+                if (ok)
+                    bodies.atmosphereModel[body] = modelIndex(path, modelIndices);
+            }
+            else
+                ok = false;
+
+            if (!ok)
+            {
+                std::cout << "ERROR::SCENE:: " << filename << ":" << lineNumber << ": " << line << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // appends `count` bodies on random orbits for scaling tests. each copies the model, tilt and (shrunk) size of one of
+    // the lit root bodies already in the scene, so the synthetic bodies look like small planets. the same seed always
+    // gives the same bodies.
+    void AddSyntheticBodies(int count, unsigned int seed)
+    {
+        std::vector<int> templates;
+        for (size_t i = 0; i < bodies.Count(); i++)
+        {
+            if (!bodies.emissive[i] && bodies.parent[i] < 0)
+                templates.push_back((int) i);
+        }
+        if (templates.empty())
+            return;
+        // std::mt19937 output is fixed by the standard, the distributions are not, hence the manual mapping
+        std::mt19937 random(seed);
+        auto uniform = [&random](float low, float high) {
+            return low + (high - low) * (float) (random() / 4294967296.0);
+        };
+        for (int n = 0; n < count; n++)
+        {
+            int source = templates[n % templates.size()];
+            addBody("synthetic_" + std::to_string(n), bodies.model[source]);
+            int body = (int) bodies.Count() - 1;
+            bodies.orbitRadius[body] = uniform(15.0f, 70.0f);
+            bodies.orbitRate[body] = uniform(0.05f, 0.5f) * (random() & 1 ? 1.0f : -1.0f);
+            bodies.orbitHeight[body] = uniform(1.0f, 7.0f);
+            bodies.size[body] = bodies.size[source] * uniform(0.1f, 0.3f);
+            bodies.spinRate[body] = uniform(-1.0f, 1.0f);
+            bodies.tilt[body] = bodies.tilt[source];
+        }
+    }
+
+    // gives `count` bodies without a light, in body order, a point light of random colour and range for scaling tests.
+    // deterministic like AddSyntheticBodies.
+    void AddSyntheticLights(int count, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        auto uniform = [&random](float low, float high) {
+            return low + (high - low) * (float) (random() / 4294967296.0);
+        };
+        for (size_t i = 0; i < bodies.Count() && count > 0; i++)
+        {
+            if (bodies.lightRange[i] > 0.0f || bodies.emissive[i])
+                continue;
+            bodies.lightColor[i] = glm::vec3(uniform(0.2f, 1.0f), uniform(0.2f, 1.0f), uniform(0.2f, 1.0f));
+            bodies.lightRange[i] = uniform(3.0f, 12.0f);
+            count--;
+        }
+    }
+
+private:
+    int modelIndex(const std::string &path, std::map<std::string, int> &indices)
+    {
+        auto it = indices.find(path);
+        if (it != indices.end())
+            return it->second;
+        models.push_back(path);
+        return indices[path] = (int) models.size() - 1;
+    }
+
+    void addBody(const std::string &name, int model)
+    {
+        bodies.name.push_back(name);
+        bodies.parent.push_back(-1);
+        bodies.model.push_back(model);
+        bodies.orbitRadius.push_back(0.0f);
+        bodies.orbitRate.push_back(0.0f);
+        bodies.orbitHeight.push_back(0.0f);
+        bodies.size.push_back(1.0f);
+        bodies.spinRate.push_back(0.0f);
+        bodies.tilt.push_back(0.0f);
+        bodies.emissive.push_back(0);
+        bodies.atmosphereModel.push_back(-1);
+        bodies.atmosphereSize.push_back(0.0f);
+        bodies.atmosphereColor.push_back(glm::vec4(1.0f));
+        bodies.lightColor.push_back(glm::vec3(1.0f));
+        bodies.lightRange.push_back(0.0f);
+        bodies.position.push_back(glm::vec3(0.0f));
+        bodies.transform.push_back(glm::mat4(1.0f));
+        bodies.atmosphereTransform.push_back(glm::mat4(1.0f));
+        bodies.normalMatrix.push_back(glm::mat3(1.0f));
+        bodies.atmosphereNormalMatrix.push_back(glm::mat3(1.0f));
+    }
+};
+#endif
@@ -8,15 +8,36 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
 #include <common.h>
+#include <learnopengl/frame_uniforms.h>
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/program_cache.h>
+#include <learnopengl/trace.h>
+
+// location of a uniform resolved once with Shader::GetUniform, for setters on the per-frame path.
+// a default constructed handle (or one for a name the program doesn't use) is -1 and ignored by GL.
+struct UniformHandle
+{
+    GLint location = -1;
+};
+
+// Blocking shaders are usable when constructed. Deferred ones only submit their compile and link; they have to be
+// finished (Shader::Finish, or Shader::Ready returning true) before any uniform is set, so the driver can build
+// several programs at once and the caller can load assets meanwhile.
+enum class CompileMode { Blocking, Deferred };
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly. `defines` ("#define NAME\n" lines) are inserted into every stage
+    // right after its #version line, see ShaderVariants.
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::string &defines = std::string(), CompileMode mode = CompileMode::Blocking)
     {
+        TRACE_SCOPE_DETAIL("Shader", std::string(vertexPath) + " + " + fragmentPath + (defines.empty() ? "" : "\n" + defines));
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -64,29 +85,49 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if (!defines.empty())
+        {
+            vertexCode = InjectDefines(vertexCode, defines);
+            fragmentCode = InjectDefines(fragmentCode, defines);
+            if (geometryPath != nullptr)
+                geometryCode = InjectDefines(geometryCode, defines);
+        }
+        // 2. restore the linked program from the binary cache, see ProgramCache
+        cacheKey = ProgramCache::Key({&vertexCode, &fragmentCode, &geometryCode});
+        if (ProgramCache::Available())
+        {
+            ID = glCreateProgram();
+            if (ProgramCache::Load(ID, cacheKey))
+            {
+                ProgramCache::Hits()++;
+                cacheUniformLocations();
+                bindUniformBlocks();
+                return;
+            }
+            // a program a binary was rejected for is unlinked; start over with a fresh one
+            glDeleteProgram(ID);
+        }
+        ProgramCache::Misses()++;
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders. nothing here waits for the driver, the results are checked in Finish
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
+        unsigned int geometry = 0;
         if(geometryPath != nullptr)
         {
             const char * gShaderCode = geometryCode.c_str();
             geometry = glCreateShader(GL_GEOMETRY_SHADER);
             glShaderSource(geometry, 1, &gShaderCode, NULL);
             glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
         ID = glCreateProgram();
@@ -94,81 +135,245 @@ public:
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        ProgramCache::PrepareLink(ID);
         glLinkProgram(ID);
+        stages[0] = vertex;
+        stages[1] = fragment;
+        stages[2] = geometry;
+        pending = true;
+        if (mode == CompileMode::Blocking)
+            Finish();
+    }
+    // waits for the compile and link of a deferred shader, reports their errors and makes the program usable.
+    // does nothing for a finished one.
+    // ------------------------------------------------------------------------
+    void Finish()
+    {
+        if (!pending)
+            return;
+        TRACE_SCOPE("Shader::Finish");
+        pending = false;
+        checkCompileErrors(stages[0], "VERTEX");
+        checkCompileErrors(stages[1], "FRAGMENT");
+        if (stages[2] != 0)
+            checkCompileErrors(stages[2], "GEOMETRY");
         checkCompileErrors(ID, "PROGRAM");
+        ProgramCache::Store(ID, cacheKey);
+        cacheUniformLocations();
+        bindUniformBlocks();
         // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        for (unsigned int &stage : stages)
+        {
+            if (stage != 0)
+                glDeleteShader(stage);
+            stage = 0;
+        }
+    }
+    // true, after finishing it, once the program can be used without waiting. asks the driver through
+    // KHR_parallel_shader_compile; a driver without it builds on the calling thread anyway, so there this finishes the
+    // program right away at the cost the blocking constructor would have had.
+    // ------------------------------------------------------------------------
+    bool Ready()
+    {
+        if (!pending)
+            return true;
+        if (!GLExtensions::MaxShaderCompilerThreads())
+        {
+            Finish();
+            return true;
+        }
+        GLint complete = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+        if (complete != GL_TRUE)
+            return false;
+        Finish();
+        return true;
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        GLStateCache::Instance().UseProgram(ID);
+    }
+    // `source` with `defines` after its first line (the #version directive, which has to stay first). a #line directive
+    // keeps compiler messages pointing at the lines of the file.
+    // ------------------------------------------------------------------------
+    static std::string InjectDefines(const std::string &source, const std::string &defines)
+    {
+        std::string::size_type end = source.find('\n');
+        if (end == std::string::npos)
+            return source;
+        return source.substr(0, end + 1) + defines + "#line 2\n" + source.substr(end + 1);
+    }
+    // resolves a uniform name once; the returned handle is valid for the lifetime of the program
+    // ------------------------------------------------------------------------
+    UniformHandle GetUniform(const std::string &name) const
+    {
+        UniformHandle handle;
+        handle.location = getLocation(name);
+        return handle;
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(getLocation(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(getLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(getLocation(name), value); 
     }
     // ------------------------------------------------------------------------
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(getLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(getLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(getLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(getLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(getLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(getLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // handle based setters, no name lookup at all
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.location, (int)value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.location, value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.location, value);
+    }
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        glUniform2fv(handle.location, 1, &value[0]);
+    }
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        glUniform3fv(handle.location, 1, &value[0]);
+    }
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    {
+        glUniform4fv(handle.location, 1, &value[0]);
+    }
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(handle.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // a deferred compile and link that Finish has not checked yet, and its shader objects
+    bool pending = false;
+    unsigned int stages[3] = {0, 0, 0};
+    uint64_t cacheKey = 0;
+    // every active uniform of the linked program, filled once after linking
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // introspects the linked program so the setters never have to ask the driver for a location again.
+    // array uniforms are registered per element ("lights[3]") and under their bare name for element 0.
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniformName(name.c_str(), length);
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            // members of uniform blocks have no location
+            if (location < 0)
+                continue;
+            uniformLocations[uniformName] = location;
+
+            std::string::size_type bracket = uniformName.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == uniformName.size())
+            {
+                std::string baseName = uniformName.substr(0, bracket);
+                uniformLocations[baseName] = location;
+                for (GLint element = 1; element < size; element++)
+                {
+                    std::string elementName = baseName + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
+    // uniform blocks shared by all programs live at fixed binding points. GLSL 330 has no layout(binding = N) so the
+    // binding is assigned here for every program that declares the block.
+    // ------------------------------------------------------------------------
+    void bindUniformBlocks()
+    {
+        static const std::pair<const char*, GLuint> sharedBlocks[] = {
+                {"FrameData", FRAME_DATA_BINDING},
+        };
+        for (const auto &block : sharedBlocks)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, block.first);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, block.second);
+        }
+    }
+
+    // cached location of `name`, -1 (ignored by glUniform*) when the program has no such active uniform
+    GLint getLocation(const std::string &name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
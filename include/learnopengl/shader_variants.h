@@ -0,0 +1,121 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <learnopengl/shader.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+// compile time specializations of one vertex + fragment shader pair. every feature bit of a variant key becomes a
+// #define in both stages, so the shaders choose code paths with #ifdef instead of branching on uniforms per fragment.
+// variants are compiled the first time they are requested and kept for the lifetime of the set. variants expected later
+// can be submitted up front with Prepare; with KHR_parallel_shader_compile the driver builds them in the background.
+class ShaderVariants
+{
+public:
+    // feature bits of a variant key
+    static const unsigned int BLINN = 1 << 0;               // Blinn-Phong instead of Phong specular
+    static const unsigned int HAS_SPECULAR_MAP = 1 << 1;    // specular colour from material.texture_specular1
+    static const unsigned int ATMOSPHERE = 1 << 2;          // tinted, translucent output for the atmosphere shells
+    static const unsigned int INSTANCED = 1 << 3;           // model and normal matrix per instance instead of per draw
+    static const unsigned int FEATURE_COUNT = 4;
+    // features that change the inputs and outputs of a variant; the others only change how it shades
+    static const unsigned int INTERFACE = ATMOSPHERE | INSTANCED;
+
+    ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath)
+            : vertexPath(vertexPath), fragmentPath(fragmentPath)
+    {
+    }
+
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // submits the variant for the features in `key` without waiting for it
+    void Prepare(unsigned int key)
+    {
+        variant(key);
+    }
+
+    // the variant for the features in `key`, compiled on first use and waited for when still compiling
+    Shader &Get(unsigned int key)
+    {
+        Shader &shader = variant(key);
+        shader.Finish();
+        return shader;
+    }
+
+    // the variant for `key` if it is ready. otherwise, so a frame never waits for the driver, a ready variant with the
+    // same interface: BLINN flipped, HAS_SPECULAR_MAP cleared, or the minimal one. null when not even the minimal
+    // variant is ready, the caller skips the draw then; compiling that one up front with Get avoids it.
+    Shader *Best(unsigned int key)
+    {
+        variant(key);
+        const unsigned int candidates[] = {key, key ^ BLINN, key & ~HAS_SPECULAR_MAP,
+                                           (key ^ BLINN) & ~HAS_SPECULAR_MAP, Minimal(key)};
+        for (unsigned int candidate : candidates)
+        {
+            auto it = variants.find(candidate);
+            if (it != variants.end() && it->second->Ready())
+                return it->second.get();
+        }
+        return nullptr;
+    }
+
+    // the cheapest variant with the interface of `key`, the stand-in of last resort in Best
+    static unsigned int Minimal(unsigned int key)
+    {
+        return key & INTERFACE;
+    }
+
+    // finishes the variants the driver is done with, returns how many are still compiling
+    size_t Poll()
+    {
+        size_t pending = 0;
+        for (auto &entry : variants)
+        {
+            if (!entry.second->Ready())
+                pending++;
+        }
+        return pending;
+    }
+
+    // waits for every submitted variant
+    void Finish()
+    {
+        for (auto &entry : variants)
+            entry.second->Finish();
+    }
+
+    size_t Count() const
+    {
+        return variants.size();
+    }
+
+    // "#define NAME\n" for every feature in `key`
+    static std::string Defines(unsigned int key)
+    {
+        static const char* names[FEATURE_COUNT] = {"BLINN", "HAS_SPECULAR_MAP", "ATMOSPHERE", "INSTANCED"};
+        std::string defines;
+        for (unsigned int bit = 0; bit < FEATURE_COUNT; bit++)
+        {
+            if (key & (1u << bit))
+                defines += std::string("#define ") + names[bit] + "\n";
+        }
+        return defines;
+    }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::map<unsigned int, std::unique_ptr<Shader>> variants;
+
+    Shader &variant(unsigned int key)
+    {
+        std::unique_ptr<Shader> &entry = variants[key];
+        if (!entry)
+            entry.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, Defines(key),
+                                    CompileMode::Deferred));
+        return *entry;
+    }
+};
+#endif
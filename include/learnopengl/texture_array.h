@@ -0,0 +1,193 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/model.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/texture_loader.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// one GL_TEXTURE_2D_ARRAY size class with a fixed number of layers. layer 0 is a flat grey used by materials whose
+// image isn't uploaded yet. stored as BC1 when the texture loader compresses, RGBA8 otherwise.
+class TextureArray
+{
+public:
+    unsigned int ID;
+    int width, height, capacity;
+
+    TextureArray(int width, int height, int capacity) : width(width), height(height), capacity(capacity)
+    {
+        compressed = TextureLoader::Instance().CompressionEnabled();
+        glGenTextures(1, &ID);
+        GLStateCache::Instance().BindTexture(0, GL_TEXTURE_2D_ARRAY, ID);
+        std::vector<unsigned char> grey;
+        if (compressed)
+        {
+            // every block of a flat colour encodes the same, so one block is encoded and repeated for all levels
+            unsigned char greyBlock[64], encoded[8];
+            std::fill(greyBlock, greyBlock + 64, 128);
+            TextureCompression::EncodeColorBlock(greyBlock, encoded);
+            int levelCount = 1;
+            while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+                levelCount++;
+            for (int level = 0; level < levelCount; level++)
+            {
+                int levelWidth = std::max(1, width >> level), levelHeight = std::max(1, height >> level);
+                size_t blocks = (size_t) ((levelWidth + 3) / 4) * ((levelHeight + 3) / 4);
+                grey.resize(blocks * 8);
+                for (size_t block = 0; block < blocks; block++)
+                    std::copy(encoded, encoded + 8, &grey[block * 8]);
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, levelWidth,
+                                       levelHeight, capacity, 0, (GLsizei) grey.size() * capacity, nullptr);
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelWidth, levelHeight, 1,
+                                          GL_COMPRESSED_RGB_S3TC_DXT1_EXT, (GLsizei) grey.size(), &grey[0]);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        }
+        else
+        {
+            grey.assign((size_t) width * height * 4, 128);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, &grey[0]);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    ~TextureArray()
+    {
+        glDeleteTextures(1, &ID);
+    }
+
+    TextureArray(const TextureArray&) = delete;
+    TextureArray& operator=(const TextureArray&) = delete;
+
+    // queues `path` into the next free layer; returns the layer or -1 when the array is full
+    int Add(const std::string &path)
+    {
+        if (used >= capacity)
+            return -1;
+        int layer = used++;
+        TextureLoader::Instance().LoadLayer(path, ID, layer, width, height);
+        return layer;
+    }
+
+private:
+    bool compressed;
+    int used = 1;
+};
+
+// where a material's diffuse map lives: an array texture and a layer in it, plus the mesh's specular map (0 if none)
+struct MaterialSlot {
+    unsigned int arrayTexture = 0;
+    float layer = 0.0f;
+    unsigned int specularTexture = 0;
+};
+
+// maps the diffuse texture of every registered model to a layer of a shared texture array, so bodies with different
+// planet maps can be drawn by one instanced call. images are resampled into size classes: 2:1 equirectangular maps
+// and square maps. Update() must run once per frame on the GL thread so models that finish streaming get their layer.
+class MaterialTable
+{
+public:
+    explicit MaterialTable(int layersPerClass = 16)
+            : wide(2048, 1024, layersPerClass), square(1024, 1024, layersPerClass)
+    {
+    }
+
+    void Register(Model &model)
+    {
+        if (std::find(models.begin(), models.end(), &model) == models.end())
+            models.push_back(&model);
+    }
+
+    // assigns layers for the diffuse maps of models that became ready since the last call
+    void Update()
+    {
+        for (Model* model : models)
+        {
+            if (model->GetLoadState() != LoadState::Ready)
+                continue;
+            for (const Mesh &mesh : model->meshes)
+            {
+                const Texture* diffuse = findTexture(mesh, "texture_diffuse");
+                if (!diffuse || slots.count(diffuse->id))
+                    continue;
+                string path = model->directory + '/' + diffuse->path;
+                TextureArray &array = classFor(path);
+                int layer = array.Add(path);
+                if (layer < 0)
+                {
+                    std::cout << "WARNING::MATERIAL_TABLE:: texture array full, " << path << " stays grey" << std::endl;
+                    layer = 0;
+                }
+                Slot slot;
+                slot.array = &array;
+                slot.layer = layer;
+                slots[diffuse->id] = slot;
+            }
+        }
+    }
+
+    // slot of the mesh's diffuse map. until its layer is uploaded (or for meshes without a registered diffuse map) the
+    // grey layer of the wide class is returned, which keeps still-streaming bodies in the same batch.
+    MaterialSlot Lookup(const Mesh &mesh) const
+    {
+        MaterialSlot result;
+        result.arrayTexture = wide.ID;
+        const Texture* specular = findTexture(mesh, "texture_specular");
+        result.specularTexture = specular ? specular->id : 0;
+
+        const Texture* diffuse = findTexture(mesh, "texture_diffuse");
+        if (!diffuse)
+            return result;
+        auto it = slots.find(diffuse->id);
+        if (it == slots.end() || !TextureLoader::Instance().IsLayerUploaded(it->second.array->ID, it->second.layer))
+            return result;
+        result.arrayTexture = it->second.array->ID;
+        result.layer = (float) it->second.layer;
+        return result;
+    }
+
+private:
+    struct Slot {
+        TextureArray* array = nullptr;
+        int layer = 0;
+    };
+
+    TextureArray wide;
+    TextureArray square;
+    vector<Model*> models;
+    // keyed by the GL name of the 2D diffuse texture, which the texture loader already deduplicates by path
+    map<unsigned int, Slot> slots;
+
+    TextureArray &classFor(const string &path)
+    {
+        int width = 0, height = 0, channels = 0;
+        if (!stbi_info(path.c_str(), &width, &height, &channels) || width * 2 >= height * 3)
+            return wide;
+        return square;
+    }
+
+    static const Texture* findTexture(const Mesh &mesh, const string &type)
+    {
+        for (const Texture &texture : mesh.textures)
+        {
+            if (texture.type == type)
+                return &texture;
+        }
+        return nullptr;
+    }
+};
+#endif
@@ -0,0 +1,395 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <learnopengl/gl_extensions.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// block compressed texture with its full mip chain, ready for glCompressedTexImage2D
+struct CompressedTexture {
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// CPU BC1/BC3 (DXT1/DXT5) encoder plus an on-disk container <image>.bctex next to the source image.
+// the first run pays for decode + mip generation + encoding on the worker threads; later runs only read the
+// container, upload 4-8x less data and skip glGenerateMipmap.
+namespace TextureCompression {
+
+    const uint32_t MAGIC = 0x43424752; // "RGBC"
+    // bump whenever the encoder or the container layout changes
+    const uint32_t VERSION = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+        uint64_t sourceSize;
+        int64_t  sourceMTime;
+    };
+
+    // `variant` distinguishes several encodings of the same image, e.g. ".2048x1024" for a resampled array layer
+    inline std::string CachePath(const std::string& source, const std::string& variant = "")
+    {
+        return source + variant + ".bctex";
+    }
+
+    inline bool statSource(const std::string& source, uint64_t& size, int64_t& mtime)
+    {
+        struct stat st;
+        if (stat(source.c_str(), &st) != 0)
+            return false;
+        size = (uint64_t) st.st_size;
+        mtime = (int64_t) st.st_mtime;
+        return true;
+    }
+
+    // bytes of one mip level of a BC1/BC3 texture, 0 for any other format
+    inline uint64_t LevelSize(GLenum format, uint64_t width, uint64_t height)
+    {
+        uint64_t blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 :
+                              format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 0;
+        return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+
+    // mip levels of a full chain down to 1x1: floor(log2(max(width, height))) + 1
+    inline uint32_t MaxLevelCount(uint32_t width, uint32_t height)
+    {
+        uint32_t count = 1;
+        for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+            count++;
+        return count;
+    }
+
+    // every count and size in the container is checked against the file size and the block layout implied by
+    // width/height before anything is allocated, so a truncated or corrupt container is a miss and not a bad_alloc
+    inline bool LoadCache(const std::string& source, CompressedTexture& texture, const std::string& variant = "")
+    {
+        uint64_t size;
+        int64_t mtime;
+        if (!statSource(source, size, mtime))
+            return false;
+        FILE* file = fopen(CachePath(source, variant).c_str(), "rb");
+        if (!file)
+            return false;
+        struct stat st;
+        if (fstat(fileno(file), &st) != 0 || st.st_size < (off_t) sizeof(Header))
+        {
+            fclose(file);
+            return false;
+        }
+        uint64_t remaining = (uint64_t) st.st_size - sizeof(Header);
+
+        Header header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                     header.magic == MAGIC && header.version == VERSION &&
+                     header.sourceSize == size && header.sourceMTime == mtime &&
+                     header.width > 0 && header.height > 0 && LevelSize(header.format, 1, 1) > 0 &&
+                     header.levelCount > 0 && header.levelCount <= MaxLevelCount(header.width, header.height);
+        CompressedTexture loaded;
+        if (valid)
+        {
+            loaded.format = header.format;
+            loaded.width = (int) header.width;
+            loaded.height = (int) header.height;
+            loaded.levels.resize(header.levelCount);
+        }
+        uint64_t width = header.width, height = header.height;
+        for (unsigned int i = 0; valid && i < loaded.levels.size(); i++)
+        {
+            uint32_t levelSize;
+            valid = remaining >= sizeof(levelSize) && fread(&levelSize, sizeof(levelSize), 1, file) == 1;
+            if (!valid)
+                break;
+            remaining -= sizeof(levelSize);
+            valid = levelSize == LevelSize(header.format, width, height) && levelSize <= remaining;
+            if (!valid)
+                break;
+            remaining -= levelSize;
+            loaded.levels[i].resize(levelSize);
+            valid = fread(&loaded.levels[i][0], levelSize, 1, file) == 1;
+            width = std::max<uint64_t>(1, width / 2);
+            height = std::max<uint64_t>(1, height / 2);
+        }
+        fclose(file);
+
+        if (valid)
+            texture = std::move(loaded);
+        return valid;
+    }
+
+    // written through a temporary file so concurrent readers never see a partial container
+    inline void StoreCache(const std::string& source, const CompressedTexture& texture, const std::string& variant = "")
+    {
+        Header header;
+        if (!statSource(source, header.sourceSize, header.sourceMTime))
+            return;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.format = texture.format;
+        header.width = (uint32_t) texture.width;
+        header.height = (uint32_t) texture.height;
+        header.levelCount = (uint32_t) texture.levels.size();
+
+        std::string path = CachePath(source, variant);
+        std::string tmpPath = path + ".tmp";
+        FILE* file = fopen(tmpPath.c_str(), "wb");
+        if (!file)
+            return;
+        fwrite(&header, sizeof(header), 1, file);
+        for (const auto& level : texture.levels)
+        {
+            uint32_t levelSize = (uint32_t) level.size();
+            fwrite(&levelSize, sizeof(levelSize), 1, file);
+            if (levelSize)
+                fwrite(&level[0], levelSize, 1, file);
+        }
+        bool ok = ferror(file) == 0;
+        ok = (fclose(file) == 0) && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+            remove(tmpPath.c_str());
+    }
+
+    inline uint16_t packRGB565(const float color[3])
+    {
+        int r = std::min(31, std::max(0, (int) (color[0] * 31.0f / 255.0f + 0.5f)));
+        int g = std::min(63, std::max(0, (int) (color[1] * 63.0f / 255.0f + 0.5f)));
+        int b = std::min(31, std::max(0, (int) (color[2] * 31.0f / 255.0f + 0.5f)));
+        return (uint16_t) ((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // 4x4 RGBA block -> 8 byte BC1 color block. endpoints are the extreme pixels along the principal axis of the
+    // block's colors (range fit), always in 4 color mode.
+    inline void EncodeColorBlock(const unsigned char block[64], unsigned char out[8])
+    {
+        float mean[3] = {0, 0, 0};
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i * 4 + c] / 16.0f;
+
+        float cov[6] = {0, 0, 0, 0, 0, 0};
+        for (int i = 0; i < 16; i++)
+        {
+            float r = block[i * 4] - mean[0], g = block[i * 4 + 1] - mean[1], b = block[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+        // a few power iterations are plenty for a 3x3 covariance
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 4; iteration++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+        }
+
+        int minIndex = 0, maxIndex = 0;
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float projection = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+            if (projection < minProjection) { minProjection = projection; minIndex = i; }
+            if (projection > maxProjection) { maxProjection = projection; maxIndex = i; }
+        }
+
+        float maxColor[3] = {(float) block[maxIndex * 4], (float) block[maxIndex * 4 + 1], (float) block[maxIndex * 4 + 2]};
+        float minColor[3] = {(float) block[minIndex * 4], (float) block[minIndex * 4 + 1], (float) block[minIndex * 4 + 2]};
+        uint16_t color0 = packRGB565(maxColor);
+        uint16_t color1 = packRGB565(minColor);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][3];
+            unpackRGB565(color0, palette[0]);
+            unpackRGB565(color1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 4; p++)
+                {
+                    int dr = block[i * 4] - palette[p][0], dg = block[i * 4 + 1] - palette[p][1], db = block[i * 4 + 2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) { bestDistance = distance; best = p; }
+                }
+                indices |= (uint32_t) best << (2 * i);
+            }
+        }
+
+        out[0] = (unsigned char) (color0 & 0xff); out[1] = (unsigned char) (color0 >> 8);
+        out[2] = (unsigned char) (color1 & 0xff); out[3] = (unsigned char) (color1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char) (indices >> (8 * i));
+    }
+
+    // 4x4 RGBA block -> 8 byte BC3 alpha block (8 interpolated values between the block's min and max alpha)
+    inline void EncodeAlphaBlock(const unsigned char block[64], unsigned char out[8])
+    {
+        int alpha0 = 0, alpha1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            alpha0 = std::max(alpha0, (int) block[i * 4 + 3]);
+            alpha1 = std::min(alpha1, (int) block[i * 4 + 3]);
+        }
+        uint64_t indices = 0;
+        if (alpha0 != alpha1)
+        {
+            int palette[8] = {alpha0, alpha1};
+            for (int p = 1; p < 7; p++)
+                palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 8; p++)
+                {
+                    int distance = std::abs(block[i * 4 + 3] - palette[p]);
+                    if (distance < bestDistance) { bestDistance = distance; best = p; }
+                }
+                indices |= (uint64_t) best << (3 * i);
+            }
+        }
+        out[0] = (unsigned char) alpha0;
+        out[1] = (unsigned char) alpha1;
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char) (indices >> (8 * i));
+    }
+
+    // compresses one RGBA8 level; partial blocks at the right/bottom edge repeat the last row/column
+    inline std::vector<unsigned char> compressLevel(const unsigned char* rgba, int width, int height, GLenum format)
+    {
+        bool alpha = format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        std::vector<unsigned char> out((size_t) blocksX * blocksY * (alpha ? 16 : 8));
+        unsigned char* dst = &out[0];
+        unsigned char block[64];
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                for (int y = 0; y < 4; y++)
+                {
+                    int sy = std::min(by * 4 + y, height - 1);
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(block + (y * 4 + x) * 4, rgba + ((size_t) sy * width + sx) * 4, 4);
+                    }
+                }
+                if (alpha)
+                {
+                    EncodeAlphaBlock(block, dst);
+                    dst += 8;
+                }
+                EncodeColorBlock(block, dst);
+                dst += 8;
+            }
+        }
+        return out;
+    }
+
+    // bilinear resample of an RGBA8 image to an arbitrary size, used to fit images into texture array layers
+    inline std::vector<unsigned char> Resample(const unsigned char* rgba, int width, int height, int newWidth, int newHeight)
+    {
+        std::vector<unsigned char> out((size_t) newWidth * newHeight * 4);
+        for (int y = 0; y < newHeight; y++)
+        {
+            float sy = std::max(0.0f, (y + 0.5f) * height / newHeight - 0.5f);
+            int y0 = std::min((int) sy, height - 1), y1 = std::min(y0 + 1, height - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < newWidth; x++)
+            {
+                float sx = std::max(0.0f, (x + 0.5f) * width / newWidth - 0.5f);
+                int x0 = std::min((int) sx, width - 1), x1 = std::min(x0 + 1, width - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++)
+                {
+                    float top = rgba[((size_t) y0 * width + x0) * 4 + c] * (1 - fx) + rgba[((size_t) y0 * width + x1) * 4 + c] * fx;
+                    float bottom = rgba[((size_t) y1 * width + x0) * 4 + c] * (1 - fx) + rgba[((size_t) y1 * width + x1) * 4 + c] * fx;
+                    out[((size_t) y * newWidth + x) * 4 + c] = (unsigned char) (top * (1 - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+        return out;
+    }
+
+    // 2x2 box filter to the next mip level
+    inline std::vector<unsigned char> downsample(const std::vector<unsigned char>& rgba, int width, int height)
+    {
+        int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+        std::vector<unsigned char> out((size_t) newWidth * newHeight * 4);
+        for (int y = 0; y < newHeight; y++)
+        {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < newWidth; x++)
+            {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = rgba[((size_t) y0 * width + x0) * 4 + c] + rgba[((size_t) y0 * width + x1) * 4 + c] +
+                              rgba[((size_t) y1 * width + x0) * 4 + c] + rgba[((size_t) y1 * width + x1) * 4 + c];
+                    out[((size_t) y * newWidth + x) * 4 + c] = (unsigned char) ((sum + 2) / 4);
+                }
+            }
+        }
+        return out;
+    }
+
+    // encodes an RGBA8 image as BC1 (no alpha used, or alpha not allowed) or BC3, optionally with the full mip chain
+    // down to 1x1
+    inline void Compress(const unsigned char* rgba, int width, int height, bool mipmaps, CompressedTexture& texture,
+                         bool allowAlpha = true)
+    {
+        bool alpha = false;
+        for (size_t i = 0; allowAlpha && i < (size_t) width * height && !alpha; i++)
+            alpha = rgba[i * 4 + 3] != 255;
+
+        texture.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        texture.width = width;
+        texture.height = height;
+        texture.levels.clear();
+        texture.levels.push_back(compressLevel(rgba, width, height, texture.format));
+
+        std::vector<unsigned char> level(rgba, rgba + (size_t) width * height * 4);
+        while (mipmaps && (width > 1 || height > 1))
+        {
+            level = downsample(level, width, height);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            texture.levels.push_back(compressLevel(&level[0], width, height, texture.format));
+        }
+    }
+}
+#endif
@@ -0,0 +1,389 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state_cache.h>
+#include <learnopengl/texture_compression.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/trace.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// decodes images on the thread pool and uploads them on the GL thread.
+// Load2D/LoadCubemap reserve the texture name right away and return it, so callers (Model, main) can keep the id
+// while the JPEG is still being decoded. decoded images are handed back through a lock-free stack that only the
+// GL thread drains, in ProcessUploads or Finish. the same file requested twice shares one texture.
+// when the driver supports S3TC, images are transcoded to BC1/BC3 (with a precomputed mip chain for 2D textures) on
+// the workers and cached as <image>.bctex, so warm starts upload compressed data only.
+class TextureLoader
+{
+public:
+    static TextureLoader& Instance()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    // queues decoding of a 2D texture with a full mip chain
+    unsigned int Load2D(const std::string &filename)
+    {
+        auto loaded = loaded2D.find(filename);
+        if (loaded != loaded2D.end())
+        {
+            // reserved so far, the image is wanted now
+            if (reserved2D.erase(loaded->second))
+                enqueue(filename, loaded->second, GL_TEXTURE_2D);
+            return loaded->second;
+        }
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        enqueue(filename, textureID, GL_TEXTURE_2D);
+        loaded2D[filename] = textureID;
+        ProcessUploads();
+        return textureID;
+    }
+
+    // the name Load2D returns for `filename`, without decoding the image into it. for images only sampled through
+    // another texture (array layers, see MaterialTable) whose 2D name merely identifies them; a later Load2D of the
+    // same file still loads it.
+    unsigned int Reserve2D(const std::string &filename)
+    {
+        auto loaded = loaded2D.find(filename);
+        if (loaded != loaded2D.end())
+            return loaded->second;
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        loaded2D[filename] = textureID;
+        reserved2D.insert(textureID);
+        return textureID;
+    }
+
+    // queues decoding of the six faces of a cubemap (+X, -X, +Y, -Y, +Z, -Z)
+    unsigned int LoadCubemap(const std::vector<std::string> &faces)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::Instance().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        for (unsigned int i = 0; i < faces.size(); i++)
+            enqueue(faces[i], textureID, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        ProcessUploads();
+        return textureID;
+    }
+
+    // queues decoding of `filename` into one layer of an existing GL_TEXTURE_2D_ARRAY. the image is resampled to the
+    // array size on the worker; with compression on, the array must have been allocated as BC1 (see TextureArray).
+    void LoadLayer(const std::string &filename, unsigned int arrayTexture, int layer, int width, int height)
+    {
+        pendingLayers.insert(layerKey(arrayTexture, layer));
+        enqueue(filename, arrayTexture, GL_TEXTURE_2D_ARRAY, layer, width, height);
+        ProcessUploads();
+    }
+
+    // uploads images decoded so far, at most `maxUploads` of them (all when negative) so a streaming frame can bound
+    // its upload cost. must be called on the GL thread.
+    void ProcessUploads(int maxUploads = -1)
+    {
+        DecodedImage* taken = completed.exchange(nullptr, std::memory_order_acquire);
+        while (taken)
+        {
+            DecodedImage* next = taken->next;
+            taken->next = ready;
+            ready = taken;
+            taken = next;
+        }
+
+        for (int uploaded = 0; ready && (maxUploads < 0 || uploaded < maxUploads); uploaded++)
+        {
+            DecodedImage* image = ready;
+            ready = image->next;
+            upload(*image);
+            if (--pendingImages[image->textureID] == 0)
+            {
+                pendingImages.erase(image->textureID);
+                if (image->target == GL_TEXTURE_2D_ARRAY)
+                    finishLayers(image->textureID);
+            }
+            delete image;
+            pending.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // true once every image of the texture (one, or six for a cubemap) has been uploaded
+    bool IsUploaded(unsigned int textureID) const
+    {
+        return pendingImages.find(textureID) == pendingImages.end();
+    }
+
+    // true once the layer queued with LoadLayer is uploaded with its mip chain, independent of the array's other layers.
+    // a layer whose image failed to load never is.
+    bool IsLayerUploaded(unsigned int arrayTexture, int layer) const
+    {
+        return pendingLayers.find(layerKey(arrayTexture, layer)) == pendingLayers.end();
+    }
+
+    // blocks until every queued image is decoded and uploaded. must be called on the GL thread.
+    void Finish()
+    {
+        TRACE_SCOPE("TextureLoader::Finish");
+        for (;;)
+        {
+            ProcessUploads();
+            if (pending.load(std::memory_order_relaxed) == 0)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // turns the BCn path on or off for images requested from now on
+    void SetCompressionEnabled(bool enabled)
+    {
+        compress = enabled;
+    }
+
+    bool CompressionEnabled() const
+    {
+        return compress;
+    }
+
+    // number of images requested but not uploaded yet
+    int PendingCount() const
+    {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct DecodedImage {
+        std::string path;
+        unsigned int textureID;
+        GLenum target;
+        int width = 0, height = 0, channels = 0;
+        unsigned char* pixels = nullptr;
+        CompressedTexture compressed;
+        // array layers: destination layer and size, and the resampled RGBA8 pixels when not compressing
+        int layer = 0;
+        int layerWidth = 0, layerHeight = 0;
+        std::vector<unsigned char> resampled;
+        DecodedImage* next = nullptr;
+    };
+
+    std::atomic<DecodedImage*> completed{nullptr};
+    std::atomic<int> pending{0};
+    // GL thread only: decoded images taken off the stack but not uploaded yet, images outstanding per texture,
+    // textures already requested by path and those of them only reserved
+    DecodedImage* ready = nullptr;
+    std::unordered_map<unsigned int, int> pendingImages;
+    std::unordered_map<std::string, unsigned int> loaded2D;
+    std::unordered_set<unsigned int> reserved2D;
+    // array layers (see layerKey) queued but not usable yet; uncompressed ones also wait in unmippedLayers for the mip
+    // chain of their array, which is generated once when the array has no images outstanding
+    std::unordered_set<uint64_t> pendingLayers;
+    std::unordered_map<unsigned int, std::vector<int>> unmippedLayers;
+    bool compress;
+
+    // the first Instance() call happens on the GL thread, so the extension query is safe here
+    TextureLoader() : compress(GLExtensions::Has("GL_EXT_texture_compression_s3tc"))
+    {
+    }
+
+    static uint64_t layerKey(unsigned int arrayTexture, int layer)
+    {
+        return (uint64_t) arrayTexture << 32 | (uint32_t) layer;
+    }
+
+    // the array's last outstanding layer is uploaded: one mip generation covers every layer uploaded without mips
+    void finishLayers(unsigned int arrayTexture)
+    {
+        auto unmipped = unmippedLayers.find(arrayTexture);
+        if (unmipped == unmippedLayers.end())
+            return;
+        GLStateCache::Instance().BindTexture(0, GL_TEXTURE_2D_ARRAY, arrayTexture);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        for (int layer : unmipped->second)
+            pendingLayers.erase(layerKey(arrayTexture, layer));
+        unmippedLayers.erase(unmipped);
+    }
+
+    void enqueue(const std::string &path, unsigned int textureID, GLenum target, int layer = 0,
+                 int layerWidth = 0, int layerHeight = 0)
+    {
+        DecodedImage* image = new DecodedImage;
+        image->path = path;
+        image->textureID = textureID;
+        image->target = target;
+        image->layer = layer;
+        image->layerWidth = layerWidth;
+        image->layerHeight = layerHeight;
+        pending.fetch_add(1, std::memory_order_relaxed);
+        pendingImages[textureID]++;
+
+        bool compressImage = compress;
+        ThreadPool::Instance().Submit([this, image, compressImage]() {
+            TRACE_SCOPE_DETAIL("decodeImage", image->path);
+            if (image->target == GL_TEXTURE_2D_ARRAY)
+                decodeLayer(*image, compressImage);
+            else if (compressImage)
+                decodeCompressed(*image);
+            else
+                image->pixels = stbi_load(image->path.c_str(), &image->width, &image->height, &image->channels, 0);
+            // push onto the completed stack; the GL thread takes the whole list at once
+            image->next = completed.load(std::memory_order_relaxed);
+            while (!completed.compare_exchange_weak(image->next, image, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        });
+    }
+
+    // worker side of array layers: decode, resample to the layer size and optionally encode as BC1 (cached per size)
+    static void decodeLayer(DecodedImage &image, bool compressImage)
+    {
+        std::string variant = "." + std::to_string(image.layerWidth) + "x" + std::to_string(image.layerHeight);
+        // the layer size is baked into the variant, but a corrupt container must not reach the array upload either
+        if (compressImage && TextureCompression::LoadCache(image.path, image.compressed, variant) &&
+            image.compressed.width == image.layerWidth && image.compressed.height == image.layerHeight)
+            return;
+        unsigned char* rgba = stbi_load(image.path.c_str(), &image.width, &image.height, &image.channels, 4);
+        if (!rgba)
+            return;
+        image.resampled = TextureCompression::Resample(rgba, image.width, image.height, image.layerWidth, image.layerHeight);
+        stbi_image_free(rgba);
+        if (compressImage)
+        {
+            TextureCompression::Compress(&image.resampled[0], image.layerWidth, image.layerHeight, true, image.compressed, false);
+            image.resampled.clear();
+            TextureCompression::StoreCache(image.path, image.compressed, variant);
+        }
+    }
+
+    // worker side of the BCn path: reuse the container when it is up to date, otherwise decode, encode and store it.
+    // cubemap faces are sampled without mipmaps, so only 2D textures get a mip chain.
+    static void decodeCompressed(DecodedImage &image)
+    {
+        if (TextureCompression::LoadCache(image.path, image.compressed))
+            return;
+        unsigned char* rgba = stbi_load(image.path.c_str(), &image.width, &image.height, &image.channels, 4);
+        if (!rgba)
+            return;
+        TextureCompression::Compress(rgba, image.width, image.height, image.target == GL_TEXTURE_2D, image.compressed);
+        stbi_image_free(rgba);
+        TextureCompression::StoreCache(image.path, image.compressed);
+    }
+
+    static GLenum formatFor(int channels)
+    {
+        if (channels == 1)
+            return GL_RED;
+        if (channels == 4)
+            return GL_RGBA;
+        return GL_RGB;
+    }
+
+    void uploadCompressed(DecodedImage &image)
+    {
+        const CompressedTexture &compressed = image.compressed;
+        GLenum bindTarget = image.target == GL_TEXTURE_2D ? GL_TEXTURE_2D : GL_TEXTURE_CUBE_MAP;
+        GLStateCache::Instance().BindTexture(0, bindTarget, image.textureID);
+        for (unsigned int level = 0; level < compressed.levels.size(); level++)
+        {
+            int width = std::max(1, compressed.width >> level), height = std::max(1, compressed.height >> level);
+            glCompressedTexImage2D(image.target, level, compressed.format, width, height, 0,
+                                   (GLsizei) compressed.levels[level].size(), &compressed.levels[level][0]);
+        }
+        if (image.target == GL_TEXTURE_2D)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) compressed.levels.size() - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+    }
+
+    void uploadLayer(DecodedImage &image)
+    {
+        GLStateCache::Instance().BindTexture(0, GL_TEXTURE_2D_ARRAY, image.textureID);
+        if (!image.compressed.levels.empty())
+        {
+            const CompressedTexture &compressed = image.compressed;
+            for (unsigned int level = 0; level < compressed.levels.size(); level++)
+            {
+                int width = std::max(1, compressed.width >> level), height = std::max(1, compressed.height >> level);
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, image.layer, width, height, 1,
+                                          compressed.format, (GLsizei) compressed.levels[level].size(),
+                                          &compressed.levels[level][0]);
+            }
+            pendingLayers.erase(layerKey(image.textureID, image.layer));
+        }
+        else if (!image.resampled.empty())
+        {
+            // the mips follow in finishLayers
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer, image.layerWidth, image.layerHeight, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, &image.resampled[0]);
+            unmippedLayers[image.textureID].push_back(image.layer);
+        }
+        else
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        }
+    }
+
+    void upload(DecodedImage &image)
+    {
+        TRACE_SCOPE_DETAIL("uploadTexture", image.path);
+        if (image.target == GL_TEXTURE_2D_ARRAY)
+        {
+            uploadLayer(image);
+            return;
+        }
+        if (!image.compressed.levels.empty())
+        {
+            uploadCompressed(image);
+            return;
+        }
+        if (!image.pixels)
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            return;
+        }
+
+        GLenum format = formatFor(image.channels);
+        // rows of 1 and 3 channel images aren't necessarily 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (image.target == GL_TEXTURE_2D)
+        {
+            GLStateCache::Instance().BindTexture(0, GL_TEXTURE_2D, image.textureID);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        else
+        {
+            GLStateCache::Instance().BindTexture(0, GL_TEXTURE_CUBE_MAP, image.textureID);
+            glTexImage2D(image.target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        stbi_image_free(image.pixels);
+    }
+};
+#endif
@@ -0,0 +1,123 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <learnopengl/trace.h>
+
+// fixed size pool of worker threads for CPU-only work (image decoding, mesh import, per-frame data parallel passes).
+// jobs must never touch OpenGL: results are handed back to the GL thread by the caller.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount)
+    {
+        for (unsigned int i = 0; i < std::max(1u, threadCount); i++)
+        {
+            workers.emplace_back([this, i]() {
+                Trace::Instance().NameThread("worker " + std::to_string(i));
+                workerLoop();
+            });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // shared pool sized to the machine, leaving one core for the GL thread
+    static ThreadPool& Instance()
+    {
+        static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        wakeUp.notify_one();
+    }
+
+    // runs body(0) .. body(count - 1) spread over the workers and the calling thread and returns when all are done.
+    // the caller keeps taking items itself, so a pool busy with long jobs only means less help, never a stall; helpers
+    // that start after everything is taken return without touching `body`.
+    void ParallelFor(size_t count, const std::function<void(size_t)> &body)
+    {
+        struct Progress {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto progress = std::make_shared<Progress>();
+        auto work = [progress, count, &body]() {
+            for (size_t i = progress->next++; i < count; i = progress->next++)
+            {
+                body(i);
+                if (++progress->done == count)
+                {
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    progress->finished.notify_all();
+                }
+            }
+        };
+        size_t helpers = std::min<size_t>(ThreadCount(), count > 0 ? count - 1 : 0);
+        for (size_t i = 0; i < helpers; i++)
+            Submit(work);
+        work();
+        std::unique_lock<std::mutex> lock(progress->mutex);
+        progress->finished.wait(lock, [&progress, count]() { return progress->done == count; });
+    }
+
+    unsigned int ThreadCount() const
+    {
+        return (unsigned int) workers.size();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+#endif
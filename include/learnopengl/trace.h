@@ -0,0 +1,216 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// trace recorder for startup and frame timelines, written as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// every thread appends to its own chunked buffer, so recording takes no locks; Write can run while other threads are
+// still recording and sees everything they published before. nothing is recorded until Start().
+//     TRACE_SCOPE("name");                     times the enclosing block
+//     TRACE_SCOPE_DETAIL("name", path);        same, with a string shown in the event's args (only built when tracing)
+class Trace
+{
+public:
+    // events beyond this are dropped, keeps a forgotten --trace from eating memory in long sessions
+    static const uint64_t MAX_EVENTS = 1 << 20;
+
+    static Trace &Instance()
+    {
+        static Trace trace;
+        return trace;
+    }
+
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    void Start()
+    {
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+    bool Enabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // nanoseconds since the recorder was created
+    uint64_t Now() const
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // name shown for the calling thread. call before the thread records anything; costs nothing when not tracing.
+    void NameThread(const std::string &name)
+    {
+        pendingThreadName() = name;
+    }
+
+    // `name` must outlive the recorder (string literals)
+    void Record(const char* name, uint64_t start, uint64_t end, std::string detail = std::string())
+    {
+        if (recorded.fetch_add(1, std::memory_order_relaxed) >= MAX_EVENTS)
+            return;
+        ThreadBuffer &buffer = threadBuffer();
+        Chunk* chunk = buffer.tail;
+        size_t count = chunk->count.load(std::memory_order_relaxed);
+        if (count == Chunk::SIZE)
+        {
+            Chunk* next = new Chunk;
+            chunk->next.store(next, std::memory_order_release);
+            buffer.tail = chunk = next;
+            count = 0;
+        }
+        Event &event = chunk->events[count];
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        event.detail = std::move(detail);
+        chunk->count.store(count + 1, std::memory_order_release);
+    }
+
+    bool Write(const std::string &filename) const
+    {
+        FILE* file = fopen(filename.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "ERROR::TRACE:: cannot write " << filename << std::endl;
+            return false;
+        }
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        bool first = true;
+        for (ThreadBuffer* buffer = threads.load(std::memory_order_acquire); buffer; buffer = buffer->next)
+        {
+            std::string threadName = buffer->name.empty() ? "thread " + std::to_string(buffer->id) : buffer->name;
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                    first ? "" : ",\n", buffer->id, escape(threadName).c_str());
+            first = false;
+            for (const Chunk* chunk = &buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+            {
+                size_t count = chunk->count.load(std::memory_order_acquire);
+                for (size_t i = 0; i < count; i++)
+                {
+                    const Event &event = chunk->events[i];
+                    fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                            escape(event.name).c_str(), buffer->id, event.start / 1000.0, (event.end - event.start) / 1000.0);
+                    if (!event.detail.empty())
+                        fprintf(file, ", \"args\": {\"detail\": \"%s\"}", escape(event.detail).c_str());
+                    fprintf(file, "}");
+                }
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct Event {
+        const char* name;
+        uint64_t start, end;
+        std::string detail;
+    };
+
+    // written by its thread only; count is published after the event so readers never see a half-written one
+    struct Chunk {
+        static const size_t SIZE = 1024;
+        Event events[SIZE];
+        std::atomic<size_t> count{0};
+        std::atomic<Chunk*> next{nullptr};
+    };
+
+    // one per recording thread, linked into `threads` and kept until exit like the threads themselves
+    struct ThreadBuffer {
+        int id;
+        std::string name;
+        Chunk head;
+        Chunk* tail = &head;
+        ThreadBuffer* next = nullptr;
+    };
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::atomic<bool> enabled{false};
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<int> threadCount{0};
+    std::atomic<ThreadBuffer*> threads{nullptr};
+
+    Trace() = default;
+
+    ThreadBuffer &threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer)
+        {
+            buffer = new ThreadBuffer;
+            buffer->id = threadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+            buffer->name = pendingThreadName();
+            buffer->next = threads.load(std::memory_order_relaxed);
+            while (!threads.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed))
+                ;
+        }
+        return *buffer;
+    }
+
+    static std::string &pendingThreadName()
+    {
+        thread_local std::string name;
+        return name;
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char) c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// records the lifetime of the object (or until End) as one event
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, std::string detail = std::string())
+            : name(name), detail(std::move(detail)), start(Trace::Instance().Enabled() ? Trace::Instance().Now() : 0),
+              active(Trace::Instance().Enabled())
+    {
+    }
+
+    ~TraceScope()
+    {
+        End();
+    }
+
+    // records the event now instead of at the end of the block
+    void End()
+    {
+        if (active)
+            Trace::Instance().Record(name, start, Trace::Instance().Now(), std::move(detail));
+        active = false;
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    std::string detail;
+    uint64_t start;
+    bool active;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_DETAIL(name, detail) \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, Trace::Instance().Enabled() ? std::string(detail) : std::string())
+#endif
@@ -0,0 +1,157 @@
+#ifndef VERTEX_LAYOUT_H
+#define VERTEX_LAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// one vertex attribute as glVertexAttribPointer sees it
+struct VertexAttribute {
+    unsigned int location;
+    int components;
+    GLenum type;
+    GLboolean normalized;
+    unsigned int offset;
+};
+
+// how a mesh's vertices are stored on the GPU. meshes keep the full float Vertex on the CPU (import, mesh cache, LOD
+// building) and Pack it into the layout when uploading; the VAO setup comes from the same attribute list.
+//   Full     56 bytes: float position, normal, uv, tangent, bitangent at locations 0-4
+//   Compact  24 bytes: float position; normal and tangent as normalized 10-10-10-2 integers (decoded by the vertex
+//            fetch, so shaders still read vec3/vec4), half float uv. the bitangent is not stored: tangent.w holds its
+//            sign and shaders rebuild it as cross(normal, tangent.xyz) * sign(tangent.w); location 4 stays disabled.
+class VertexLayout
+{
+public:
+    unsigned int stride = 0;
+    std::vector<VertexAttribute> attributes;
+
+    static const VertexLayout &Full()
+    {
+        static const VertexLayout layout(56, {
+                {0, 3, GL_FLOAT, GL_FALSE, 0},
+                {1, 3, GL_FLOAT, GL_FALSE, 12},
+                {2, 2, GL_FLOAT, GL_FALSE, 24},
+                {3, 3, GL_FLOAT, GL_FALSE, 32},
+                {4, 3, GL_FLOAT, GL_FALSE, 44}});
+        return layout;
+    }
+
+    static const VertexLayout &Compact()
+    {
+        static const VertexLayout layout(24, {
+                {0, 3, GL_FLOAT, GL_FALSE, 0},
+                {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 12},
+                {2, 2, GL_HALF_FLOAT, GL_FALSE, 16},
+                {3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 20}});
+        return layout;
+    }
+
+    bool IsCompact() const
+    {
+        return this == &Compact();
+    }
+
+    // attribute pointers for the vertex buffer currently bound to GL_ARRAY_BUFFER
+    void Setup() const
+    {
+        for (const VertexAttribute &attribute : attributes)
+        {
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  stride, (void*)(size_t) attribute.offset);
+        }
+    }
+
+    // GPU bytes of `vertices` in this layout
+    template<typename Vertex>
+    std::vector<unsigned char> Pack(const std::vector<Vertex> &vertices) const
+    {
+        std::vector<unsigned char> bytes(vertices.size() * stride);
+        if (!IsCompact())
+        {
+            for (size_t i = 0; i < vertices.size(); i++)
+            {
+                unsigned char* out = &bytes[i * stride];
+                const Vertex &vertex = vertices[i];
+                memcpy(out, &vertex.Position, 12);
+                memcpy(out + 12, &vertex.Normal, 12);
+                memcpy(out + 24, &vertex.TexCoords, 8);
+                memcpy(out + 32, &vertex.Tangent, 12);
+                memcpy(out + 44, &vertex.Bitangent, 12);
+            }
+            return bytes;
+        }
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            unsigned char* out = &bytes[i * stride];
+            const Vertex &vertex = vertices[i];
+            float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            uint32_t normal = PackSnorm1010102(vertex.Normal, 0.0f);
+            uint32_t tangent = PackSnorm1010102(vertex.Tangent, handedness);
+            uint16_t uv[2] = {FloatToHalf(vertex.TexCoords.x), FloatToHalf(vertex.TexCoords.y)};
+            memcpy(out, &vertex.Position, 12);
+            memcpy(out + 12, &normal, 4);
+            memcpy(out + 16, uv, 4);
+            memcpy(out + 20, &tangent, 4);
+        }
+        return bytes;
+    }
+
+    // x, y, z in [-1, 1] to 10 bit and w to 2 bit signed normalized integers, x in the low bits (GL_INT_2_10_10_10_REV).
+    // GL 3.3 decodes signed normalized values as (2c + 1) / (2^b - 1), so a w of -1 reads back as -1/3: only its sign
+    // is meaningful.
+    static uint32_t PackSnorm1010102(const glm::vec3 &v, float w)
+    {
+        auto quantize = [](float value, float scale, uint32_t mask) {
+            int c = (int) std::lround(std::max(-1.0f, std::min(1.0f, value)) * scale);
+            return (uint32_t) c & mask;
+        };
+        return quantize(v.x, 511.0f, 0x3ff) | quantize(v.y, 511.0f, 0x3ff) << 10 | quantize(v.z, 511.0f, 0x3ff) << 20 |
+               quantize(w, 1.0f, 0x3) << 30;
+    }
+
+    // IEEE 754 binary16, round to nearest even; out of range values become infinity, tiny ones denormals or zero
+    static uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t magnitude = bits & 0x7fffffff;
+        if (magnitude >= 0x7f800000)                    // inf or nan
+            return (uint16_t) (sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+        if (magnitude >= 0x477ff000)                    // rounds to more than 65504
+            return (uint16_t) (sign | 0x7c00);
+        if (magnitude < 0x38800000)                     // below the smallest normal half
+        {
+            if (magnitude < 0x33000000)
+                return (uint16_t) sign;
+            uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+            int shift = 126 - (int) (magnitude >> 23);
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                half++;
+            return (uint16_t) (sign | half);
+        }
+        uint32_t half = (magnitude - 0x38000000) >> 13;
+        uint32_t rest = magnitude & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++;
+        return (uint16_t) (sign | half);
+    }
+
+private:
+    VertexLayout(unsigned int stride, std::vector<VertexAttribute> attributes)
+            : stride(stride), attributes(std::move(attributes))
+    {
+    }
+};
+#endif
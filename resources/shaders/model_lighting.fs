@@ -1,8 +1,13 @@
 #version 330 core
+// variants, see include/learnopengl/shader_variants.h:
+//   BLINN              Blinn-Phong instead of Phong specular
+//   HAS_SPECULAR_MAP   specular colour from material.texture_specular1, the diffuse colour otherwise
+//   ATMOSPHERE         tinted and translucent by the vertex shader's Tint
 out vec4 FragColor;
 
 struct PointLight {
     vec3 position;
+    float range;
 
     vec3 specular;
     vec3 diffuse;
@@ -14,7 +19,8 @@ struct PointLight {
 };
 
 struct Material {
-    sampler2D texture_diffuse1;
+    // diffuse maps of all bodies, one per layer (see include/learnopengl/texture_array.h)
+    sampler2DArray diffuseArray;
     sampler2D texture_specular1;
 
     float shininess;
@@ -31,14 +37,65 @@ struct DirLight {
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+#ifdef ATMOSPHERE
+in vec4 Tint;
+#endif
+flat in float Layer;
+
+// per-frame camera and light cluster state, see include/learnopengl/frame_uniforms.h
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 clusterScale;
+    vec4 clusterCount;
+    float time;
+};
+
+// light clusters, see include/learnopengl/clustered_lighting.h
+uniform samplerBuffer lights;           // 4 texels per light
+uniform usamplerBuffer lightClusters;   // (first, count) into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
 
-uniform PointLight pointLight;
 uniform Material material;
 uniform DirLight dirLight;
-uniform vec3 viewPosition;
-uniform bool blinn;
-uniform float alpha;
-uniform vec3 color;
+
+vec3 DiffuseColor()
+{
+    return texture(material.diffuseArray, vec3(TexCoords, Layer)).rgb;
+}
+
+vec3 SpecularColor()
+{
+#ifdef HAS_SPECULAR_MAP
+    return texture(material.texture_specular1, TexCoords).rgb;
+#else
+    // without a specular map the diffuse colour doubles as the specular colour
+    return DiffuseColor();
+#endif
+}
+
+PointLight FetchLight(int index)
+{
+    vec4 positionRange = texelFetch(lights, index * 4);
+    vec4 diffuseConstant = texelFetch(lights, index * 4 + 1);
+    vec4 specularLinear = texelFetch(lights, index * 4 + 2);
+    vec4 ambientQuadratic = texelFetch(lights, index * 4 + 3);
+    return PointLight(positionRange.xyz, positionRange.w, specularLinear.rgb, diffuseConstant.rgb, ambientQuadratic.rgb,
+                      diffuseConstant.w, specularLinear.w, ambientQuadratic.w);
+}
+
+// (first, count) of the light indices of the cluster holding this fragment
+uvec2 FragmentCluster()
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy * clusterScale.xy);
+    // view space depth from the third row of the view matrix
+    float depth = -dot(vec4(view[0][2], view[1][2], view[2][2], view[3][2]), vec4(FragPos, 1.0));
+    int slice = int(clamp(log(max(depth, 1e-6)) * clusterScale.z + clusterScale.w, 0.0, clusterCount.z - 1.0));
+    tile = clamp(tile, ivec2(0), ivec2(clusterCount.xy) - 1);
+    int cluster = (slice * int(clusterCount.y) + tile.y) * int(clusterCount.x) + tile.x;
+    return texelFetch(lightClusters, cluster).xy;
+}
 
 // calculates the color when using a point light.
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
@@ -47,25 +104,22 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
+#ifdef BLINN
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+#else
     vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = 0.0f;
-        if(blinn){
-
-            vec3 halfwayDir = normalize(lightDir + viewDir);
-            spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
-
-        }else{
-
-            spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-        }
-    // attenuation
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+#endif
+    // attenuation, windowed to reach zero at the light's range
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    float falloff = distance / light.range;
+    attenuation *= pow(clamp(1.0 - falloff * falloff * falloff * falloff, 0.0, 1.0), 2.0);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).rgb);
+    vec3 ambient = light.ambient * DiffuseColor();
+    vec3 diffuse = light.diffuse * diff * DiffuseColor();
+    vec3 specular = light.specular * spec * SpecularColor();
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -81,17 +135,25 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * DiffuseColor();
+    vec3 diffuse = light.diffuse * diff * DiffuseColor();
+    vec3 specular = light.specular * spec * SpecularColor();
     return (ambient + diffuse + specular);
 }
 
 void main()
 {
     vec3 normal = normalize(Normal);
-    vec3 viewDir = normalize(viewPosition - FragPos);
-    vec3 result = CalcPointLight(pointLight, normal, FragPos, viewDir);
+    vec3 viewDir = normalize(viewPosition.xyz - FragPos);
+    // only the lights whose range reaches this fragment's cluster
+    uvec2 cluster = FragmentCluster();
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; i++)
+        result += CalcPointLight(FetchLight(int(texelFetch(lightIndices, int(cluster.x + i)).r)), normal, FragPos, viewDir);
 //     result += CalcDirLight(dirLight, normal, viewDir);
-    FragColor = vec4(color.rgb * result, alpha);
+#ifdef ATMOSPHERE
+    FragColor = vec4(Tint.rgb * result, Tint.a);
+#else
+    FragColor = vec4(result, 1.0);
+#endif
 }
\ No newline at end of file
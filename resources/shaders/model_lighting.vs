@@ -1,20 +1,62 @@
 #version 330 core
+// variants, see include/learnopengl/shader_variants.h:
+//   INSTANCED    model matrix, normal matrix, tint and layer are per-instance attributes (see
+//                include/learnopengl/instanced_renderer.h) instead of uniforms
+//   ATMOSPHERE   passes the tint on to the fragment shader
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef INSTANCED
+layout (location = 5) in mat4 aModel;
+layout (location = 9) in vec4 aColor;
+layout (location = 10) in float aLayer;
+layout (location = 11) in mat3 aNormalMatrix;
+#endif
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
+#ifdef ATMOSPHERE
+out vec4 Tint;
+#endif
+flat out float Layer;
 
+// per-frame camera and light cluster state, see include/learnopengl/frame_uniforms.h
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 clusterScale;
+    vec4 clusterCount;
+    float time;
+};
+
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// transpose(inverse(mat3(model))), computed once per body on the CPU
+uniform mat3 normalMatrix;
+uniform vec3 color;
+uniform float alpha;
+uniform float layer;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = aModel;
+    // transpose(inverse(mat3(aModel))), computed once per body on the CPU
+    mat3 normalMatrix = aNormalMatrix;
+    vec4 tint = aColor;
+    Layer = aLayer;
+#else
+    vec4 tint = vec4(color, alpha);
+    Layer = layer;
+#endif
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = transpose(inverse(mat3(model))) * aNormal;
+    Normal = normalMatrix * aNormal;
     TexCoords = vec2(aTexCoords.x, 1.0 - aTexCoords.y);
+#ifdef ATMOSPHERE
+    Tint = tint;
+#endif
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
@@ -11,10 +11,27 @@
 
 #include <learnopengl/filesystem.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/shader_variants.h>
 #include <learnopengl/camera.h>
+#include <learnopengl/clustered_lighting.h>
+#include <learnopengl/gl_extensions.h>
 #include <learnopengl/model.h>
-
+#include <learnopengl/instanced_renderer.h>
+#include <learnopengl/render_queue.h>
+#include <learnopengl/scene.h>
+#include <learnopengl/culling.h>
+#include <learnopengl/frame_capture.h>
+#include <learnopengl/benchmark.h>
+#include <learnopengl/profiler.h>
+#include <learnopengl/trace.h>
+
+#include <cfloat>
+#include <cmath>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -31,6 +48,12 @@ unsigned int loadCubemap(vector<std::string> faces);
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 700;
+// bodies, their orbits and assets
+const char* SCENE_FILE = "resources/scenes/solar_system.scene";
+// models start as placeholders and stream in while the render loop already runs
+const bool STREAM_ASSETS = true;
+// texture uploads allowed per frame while streaming, keeps single frames from stalling on several big images
+const int STREAM_UPLOADS_PER_FRAME = 2;
 
 // camera
 
@@ -38,11 +61,18 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 bool blinn = true;
+// largest on-screen error in pixels a simplified mesh level may introduce
+float lodPixelError = 1.0f;
 
 // timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// size of the window's framebuffer in pixels, kept up to date by framebuffer_size_callback. differs from the window size
+// on HiDPI displays.
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
 struct PointLight {
     glm::vec3 position;
     glm::vec3 ambient;
@@ -104,13 +134,84 @@ ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
 
-int main() {
+// command line options, see PrintUsage
+struct RunOptions {
+    bool headless = false;
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    int frames = -1;             // -1 runs until the window is closed
+    float timeStep = 0.0f;       // 0 uses the wall clock
+    bool captureAll = false;
+    std::set<int> captureFrames;
+    std::string captureDirectory = ".";
+    std::string benchPath;                  // camera path file, empty when not benchmarking
+    std::string benchOutput = "bench.json";
+    int warmupFrames = 10;                  // benchmark frames left out of the statistics
+    int syntheticBodies = 0;
+    int syntheticLights = 0;
+    std::string tracePath;                  // Chrome trace of the whole run, empty when not tracing
+    bool compactVertices = true;            // quantized 24 byte vertices instead of the 56 byte float ones
+    bool multiDrawIndirect = true;          // glMultiDrawElementsIndirect when the driver has it
+    bool programCache = true;               // linked programs from shadercache/ instead of compiling GLSL
+
+    bool Benchmarking() const
+    {
+        return !benchPath.empty();
+    }
+
+    // a fixed time step makes every frame reproducible
+    bool Deterministic() const
+    {
+        return timeStep > 0.0f;
+    }
+
+    bool Capture(int frame) const
+    {
+        return captureAll || captureFrames.count(frame);
+    }
+};
+
+void PrintUsage(const char *program);
+
+bool ParseOptions(int argc, char **argv, RunOptions &options);
+
+int main(int argc, char **argv) {
+    RunOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return -1;
+    }
+    Trace::Instance().NameThread("main");
+    if (!options.tracePath.empty())
+        Trace::Instance().Start();
+    // benchmarks fly the camera path once with a fixed step, after the warm-up frames
+    CameraPath cameraPath;
+    if (options.Benchmarking()) {
+        if (!cameraPath.LoadFromFile(options.benchPath))
+            return -1;
+        if (!options.Deterministic())
+            options.timeStep = 1.0f / 60.0f;
+        if (options.frames < 0)
+            options.frames = options.warmupFrames + (int) std::ceil(cameraPath.Duration() / options.timeStep) + 1;
+    }
+    // headless runs render a fixed number of frames with a fixed step so their output can be compared
+    if (options.headless) {
+        if (options.frames < 0)
+            options.frames = 1;
+        if (!options.Deterministic())
+            options.timeStep = 1.0f / 60.0f;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
+    TraceScope windowTrace("create window");
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // headless: the window only provides the context, frames go to an offscreen framebuffer
+    if (options.headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
@@ -118,19 +219,21 @@ int main() {
 
     // glfw window creation
     // --------------------
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Solar system", NULL, NULL);
+    GLFWwindow *window = glfwCreateWindow(options.width, options.height, "Solar system", NULL, NULL);
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
         return -1;
     }
     glfwMakeContextCurrent(window);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetKeyCallback(window, key_callback);
     // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (!options.headless)
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -138,12 +241,23 @@ int main() {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    GLExtensions::Load((GLADloadproc) glfwGetProcAddress);
+    // without the indirect entry point InstancedRenderer falls back to one draw per batch
+    if (!options.multiDrawIndirect)
+        GLExtensions::MultiDrawElementsIndirect() = nullptr;
+    ProgramCache::Enabled() = options.programCache;
+
+    windowTrace.End();
+    // everything up to the first frame
+    TraceScope startupTrace("startup");
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
 
     programState = new ProgramState;
-    programState->LoadFromFile("resources/program_state.txt");
+    // deterministic runs start from the default camera instead of wherever the last session ended
+    if (!options.Deterministic())
+        programState->LoadFromFile("resources/program_state.txt");
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
     }
@@ -162,9 +276,55 @@ int main() {
 
     // build and compile shaders
     // -------------------------
-    Shader modelShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
-    Shader lightShader("resources/shaders/model_lighting.vs", "resources/shaders/light_source.fs");
-    Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
+    // everything is only submitted here; the driver compiles while the assets load, and frames draw with whatever is
+    // ready (see ShaderVariants::Best) instead of waiting for the rest
+    // lit bodies and atmospheres, one compiled variant per combination of features in use
+    ShaderVariants litShaders("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
+    Shader lightShader("resources/shaders/model_lighting.vs", "resources/shaders/light_source.fs", nullptr, "",
+                       CompileMode::Deferred);
+    Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs", nullptr, "",
+                        CompileMode::Deferred);
+    // the variants of the current lighting model. with background compiles also those of the other model and with
+    // specular maps, so toggling Blinn-Phong never stalls a frame; without them unused variants would only cost time.
+    const bool parallelCompile = GLExtensions::MaxShaderCompilerThreads() != nullptr;
+    // the minimal variant of each interface is built right away, it stands in for the others until they are ready
+    if (parallelCompile) {
+        litShaders.Get(ShaderVariants::INSTANCED);
+        litShaders.Get(ShaderVariants::INSTANCED | ShaderVariants::ATMOSPHERE);
+    }
+    for (bool variantBlinn : {blinn, !blinn}) {
+        for (bool specular : {false, true}) {
+            if (!parallelCompile && (variantBlinn != blinn || specular))
+                continue;
+            unsigned int key = ShaderVariants::INSTANCED | (variantBlinn ? ShaderVariants::BLINN : 0) |
+                               (specular ? ShaderVariants::HAS_SPECULAR_MAP : 0);
+            litShaders.Prepare(key);
+            litShaders.Prepare(key | ShaderVariants::ATMOSPHERE);
+        }
+    }
+    // camera and light cluster state shared by all three programs
+    FrameUniforms frameUniforms;
+    // diffuse maps of the lit bodies, packed into texture arrays so one instanced draw covers different planets
+    MaterialTable materials;
+    // instanced submission of the lit bodies, and one renderer per visible atmosphere shell: a renderer orders its
+    // batches by pool and texture, so shells at different detail levels would blend in the wrong order if they shared one
+    InstancedRenderer bodyBatch(&materials);
+    vector<std::unique_ptr<InstancedRenderer>> atmosphereBatches;
+    // every draw of a frame, sorted by pass, program, material and depth
+    RenderQueue renderQueue;
+    const float farPlane = 250.0f;
+    // the sun's light followed by the scene's body lights, assigned to screen space clusters every frame
+    ClusteredLighting lighting;
+    vector<PointLightData> lights;
+
+    PointLight &pointLight = programState->pointLight;
+    pointLight.position = glm::vec3(0.0f);
+    pointLight.ambient = glm::vec3(0.47f, 0.25f, 0.1f);
+    pointLight.diffuse = glm::vec3(0.6f, 0.6f, 0.3f);
+    pointLight.specular = glm::vec3(0.2f, 0.2f, 0.0f);
+    pointLight.constant = 1.0f;
+    pointLight.linear = 0.09f;
+    pointLight.quadratic = 0.0005f;
 
     float skyboxVertices[] = {
             // positions
@@ -215,7 +375,7 @@ int main() {
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    GLStateCache::Instance().BindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -233,251 +393,341 @@ int main() {
             };
     unsigned int cubemapTexture = loadCubemap(faces);
 
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
-
-
-    // load models
-    // -----------
-    Model sunModel("resources/objects/sun/sun.obj");
-    sunModel.SetShaderTextureNamePrefix("material.");
-
-    Model mercuryModel("resources/objects/mercury/mercury.obj");
-    mercuryModel.SetShaderTextureNamePrefix("material.");
-
-    Model venusModel("resources/objects/venus/venus.obj");
-    venusModel.SetShaderTextureNamePrefix("material.");
-
-    Model earthModel("resources/objects/earth/earth.obj");
-    earthModel.SetShaderTextureNamePrefix("material.");
-
-    Model atmosphereModel("resources/objects/earth/earth.obj");
-    atmosphereModel.SetShaderTextureNamePrefix("material.");
-
-    Model moonModel("resources/objects/moon/moon.obj");
-    moonModel.SetShaderTextureNamePrefix("material.");
-
-    Model marsModel("resources/objects/mars/mars.obj");
-    marsModel.SetShaderTextureNamePrefix("material.");
-
-    Model jupiterModel("resources/objects/jupiter/jupiter.obj");
-    jupiterModel.SetShaderTextureNamePrefix("material.");
-
-    Model saturnModel("resources/objects/saturn/13906_Saturn_v1_l3.obj");
-    saturnModel.SetShaderTextureNamePrefix("material.");
-
-    Model uranusModel("resources/objects/uranus/uranus.obj");
-    uranusModel.SetShaderTextureNamePrefix("material.");
-
-    Model neptuneModel("resources/objects/neptune/neptune.obj");
-    neptuneModel.SetShaderTextureNamePrefix("material.");
 
+    // load scene
+    // ----------
+    Scene scene;
+    if (!scene.LoadFromFile(SCENE_FILE))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    if (options.syntheticBodies > 0)
+        scene.AddSyntheticBodies(options.syntheticBodies, 1);
+    if (options.syntheticLights > 0)
+        scene.AddSyntheticLights(options.syntheticLights, 2);
+    BodyTable &bodies = scene.bodies;
+
+    // one model per distinct asset, shared by every body (and atmosphere) that references it
+    // streaming makes the first frames depend on load timing, so deterministic runs load everything up front
+    const bool streamAssets = STREAM_ASSETS && !options.Deterministic();
+    LoadMode loadMode = streamAssets ? LoadMode::Async : LoadMode::Blocking;
+    Mesh::DefaultLayout() = options.compactVertices ? &VertexLayout::Compact() : &VertexLayout::Full();
+    // only the emissive bodies sample their diffuse maps as 2D textures, everything else goes through the texture arrays
+    vector<bool> emissiveModel(scene.models.size(), false);
+    for (size_t i = 0; i < bodies.Count(); i++)
+    {
+        if (bodies.emissive[i])
+            emissiveModel[bodies.model[i]] = true;
+    }
+    vector<std::unique_ptr<Model>> models;
+    for (size_t m = 0; m < scene.models.size(); m++)
+    {
+        DiffuseMaps diffuseMaps = emissiveModel[m] ? DiffuseMaps::Texture2D : DiffuseMaps::ArrayLayers;
+        models.emplace_back(new Model(scene.models[m], loadMode, diffuseMaps));
+        models.back()->SetShaderTextureNamePrefix("material.");
+    }
+    // everything except emissive bodies is drawn through the texture arrays
+    for (size_t i = 0; i < bodies.Count(); i++)
+    {
+        if (!bodies.emissive[i])
+            materials.Register(*models[bodies.model[i]]);
+        if (bodies.atmosphereModel[i] >= 0)
+            materials.Register(*models[bodies.atmosphereModel[i]]);
+    }
+    materials.Update();
+    vector<BoundingSphere> modelBounds(models.size());
+    // visible atmospheres
+    vector<size_t> atmosphereOrder;
+    // without streaming, wait for the remaining image decodes and upload them before the first frame
+    if (!streamAssets)
+        TextureLoader::Instance().Finish();
+
+    // deterministic runs render every frame with the requested programs, and without background compiles there is
+    // nothing to overlap the rest of startup with
+    if (options.Deterministic() || !parallelCompile) {
+        lightShader.Finish();
+        skyboxShader.Finish();
+        litShaders.Finish();
+    }
+    // uniforms set once per body, resolved once the sun's program is built
+    UniformHandle lightModelUniform, lightNormalMatrixUniform;
+    bool lightShaderReady = false, skyboxShaderReady = false;
 
     // draw in wireframe
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    std::unique_ptr<OffscreenTarget> offscreen;
+    if (options.headless)
+        offscreen.reset(new OffscreenTarget(options.width, options.height));
+
+    // benchmark timing: CPU time until the frame is submitted, GPU time of its commands and the whole loop iteration
+    std::unique_ptr<GpuFrameTimer> gpuTimer;
+    FrameStats frameStats;
+    if (options.Benchmarking()) {
+        gpuTimer.reset(new GpuFrameTimer());
+        // measure rendering, not the display's refresh rate
+        glfwSwapInterval(0);
+    }
+
+    startupTrace.End();
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window)) {
+    for (int frame = 0; !glfwWindowShouldClose(window) && (options.frames < 0 || frame < options.frames); frame++) {
+        TRACE_SCOPE("frame");
+        auto frameStart = std::chrono::steady_clock::now();
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
+        float currentFrame = options.Deterministic() ? frame * options.timeStep : (float) glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        if (gpuTimer)
+            gpuTimer->Begin(frame);
+        Profiler::Instance().BeginFrame();
 
         // input
         // -----
         processInput(window);
+        if (options.Benchmarking()) {
+            CameraPath::Key pose = cameraPath.Sample(std::max(0, frame - options.warmupFrames) * options.timeStep);
+            programState->camera.SetPose(pose.position, pose.yaw, pose.pitch);
+        }
+
+        // streaming: upload what the background threads finished and swap in models that are complete
+        if (streamAssets)
+        {
+            PROFILE_SCOPE("streaming");
+            TextureLoader::Instance().ProcessUploads(STREAM_UPLOADS_PER_FRAME);
+            for (auto &streamingModel : models)
+                streamingModel->Update();
+            materials.Update();
+        }
+        // variants prepared for later become usable as soon as the driver is done with them
+        if (parallelCompile)
+            litShaders.Poll();
 
 
         // render
         // ------
+        if (offscreen)
+            offscreen->Bind();
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 
-        // sun
-
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        lightShader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
-                                                (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 250.0f);
+        // per-frame state, uploaded once for every program
+        // the offscreen target keeps the requested size, the window's framebuffer follows resizes (0 while minimized)
+        const int renderWidth = offscreen ? options.width : std::max(1, framebufferWidth);
+        const int renderHeight = offscreen ? options.height : std::max(1, framebufferHeight);
+        const float aspect = (float) renderWidth / (float) renderHeight;
+        const float nearPlane = 0.1f;
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), aspect, nearPlane, farPlane);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        lightShader.setMat4("projection", projection);
-        lightShader.setMat4("view", view);
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::vec3 sunPos = glm::vec3(0.0f);
-        float sunSize = 10.5f;
-        model = glm::translate(model, sunPos);
-        model = glm::scale(model, glm::vec3(sunSize));
-        model = glm::rotate(model, currentFrame/4, glm::vec3(0.0f, 1.0f, 0.0f));
-        lightShader.setMat4("model", model);
-        sunModel.Draw(lightShader);
-
-        modelShader.use();
-        modelShader.setVec3("pointLight.ambient", glm::vec3(0.47f, 0.25f, 0.1f));
-        modelShader.setVec3("pointLight.diffuse", 0.6f, 0.6f, 0.3f);
-        modelShader.setVec3("pointLight.specular", 0.2f, 0.2f, 0.0f);
-        modelShader.setVec3("pointLight.position", glm::vec3(0.0f));
-        modelShader.setFloat("pointLight.constant", 1.0f);
-        modelShader.setFloat("pointLight.linear", 0.09f);
-        modelShader.setFloat("pointLight.quadratic", 0.0005f);
-        modelShader.setVec3("viewPosition", programState->camera.Position);
-        modelShader.setFloat("material.shininess", 16.0f);
-        modelShader.setBool("blinn", blinn);
-        modelShader.setVec3("color", glm::vec3(1.0f));
-        modelShader.setFloat("alpha", 1.0f);
-        modelShader.setMat4("projection", projection);
-        modelShader.setMat4("view", view);
-        // mercury
-        model = glm::mat4(1.0f);
-        glm::vec3 mercuryPos = glm::vec3(sin(currentFrame/4)*13.5, 4.0f, cos(currentFrame/4)*13.5);
-        float mercurySize = 1.7f;
-        model = glm::translate(model, mercuryPos);
-        model = glm::scale(model, glm::vec3(mercurySize));
-        model = glm::rotate(model, currentFrame/3, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        mercuryModel.Draw(modelShader);
-
-        // venus
-        model = glm::mat4(1.0f);
-        glm::vec3 venusPos = glm::vec3(sin(currentFrame/5)*18, 4.0f, cos(currentFrame/5)*18);
-        float venusSize = 2.4f;
-        model = glm::translate(model, venusPos);
-        model = glm::scale(model, glm::vec3(venusSize));
-        model = glm::rotate(model, -currentFrame/2, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        venusModel.Draw(modelShader);
-
-        // earth
-        model = glm::mat4(1.0f);
-        glm::vec3 earthPos = glm::vec3(sin(currentFrame/6)*24.3, 4.0f, cos(currentFrame/6)*24.3);
-        float earthSize = 2.3f;
-        model = glm::translate(model, earthPos);
-        model = glm::scale(model, glm::vec3(earthSize));
-        model = glm::rotate(model, currentFrame/2, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        earthModel.Draw(modelShader);
-
-        // moon
-        model = glm::mat4(1.0f);
-        glm::vec3 moonPos = glm::vec3(earthPos.x + sin(currentFrame*2)*2.85, 4.5f, earthPos.z + cos(currentFrame*2)*2.85);
-        float moonSize = 0.3f;
-        model = glm::translate(model, moonPos);
-        model = glm::scale(model, glm::vec3(moonSize));
-        model = glm::rotate(model, currentFrame/4, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        moonModel.Draw(modelShader);
-
-        // mars
-        model = glm::mat4(1.0f);
-        glm::vec3 marsPos = glm::vec3(sin(currentFrame/7)*30, 4.0f, cos(currentFrame/7)*30);
-        float marsSize = 2.2f;
-        model = glm::translate(model, marsPos);
-        model = glm::scale(model, glm::vec3(marsSize));
-        model = glm::rotate(model, currentFrame/2, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        marsModel.Draw(modelShader);
-
-        // jupiter
-        model = glm::mat4(1.0f);
-        glm::vec3 jupiterPos = glm::vec3(sin(currentFrame/8)*37, 4.0f, cos(currentFrame/8)*37);
-        float jupiterSize = 3.7f;
-        model = glm::translate(model, jupiterPos);
-        model = glm::scale(model, glm::vec3(jupiterSize));
-        model = glm::rotate(model, currentFrame, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        jupiterModel.Draw(modelShader);
-
-        // saturn
-        model = glm::mat4(1.0f);
-        glm::vec3 saturnPos = glm::vec3(sin(currentFrame/9)*44, 4.0f, cos(currentFrame/9)*44);
-        float saturnSize = 0.01f;
-        model = glm::translate(model, saturnPos);
-        model = glm::scale(model, glm::vec3(saturnSize));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        saturnModel.Draw(modelShader);
-
-        // uranus
-        model = glm::mat4(1.0f);
-        glm::vec3 uranusPos = glm::vec3(sin(currentFrame/10)*49.6, 4.0f, cos(currentFrame/10)*49.6);
-        float uranusSize = 2.5f;
-        model = glm::translate(model, uranusPos);
-        model = glm::scale(model, glm::vec3(uranusSize));
-        model = glm::rotate(model, currentFrame/2, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        uranusModel.Draw(modelShader);
-
-        // neptune
-        model = glm::mat4(1.0f);
-        glm::vec3 neptunePos = glm::vec3(sin(currentFrame/11)*56, 4.0f, cos(currentFrame/11)*56);
-        float neptuneSize = 2.6f;
-        model = glm::translate(model, neptunePos);
-        model = glm::scale(model, glm::vec3(neptuneSize));
-        model = glm::rotate(model, currentFrame/2, glm::vec3(0.0f, 1.0f, 0.0f));
-        modelShader.setMat4("model", model);
-        neptuneModel.Draw(modelShader);
-
-        //atmosphere
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-        glEnable(GL_DEPTH_TEST);
-        glDepthFunc(GL_LEQUAL);
-        modelShader.setVec3("color", glm::vec3(0.53f, 0.65f, 0.81f));
-        modelShader.setFloat("alpha", 0.1f);
-
-        model = glm::mat4(1.0f);
-        glm::vec3 atmospherePos = glm::vec3(sin(currentFrame/6)*24.3, 4.0f, cos(currentFrame/6)*24.3);
-        float atmosphereSize = 2.4f;
-        model = glm::translate(model, atmospherePos);
-        model = glm::scale(model, glm::vec3(atmosphereSize));
-        modelShader.setMat4("model", model);
-        atmosphereModel.Draw(modelShader);
-
-        model = glm::mat4(1.0f);
-        atmospherePos = glm::vec3(sin(currentFrame/5)*18, 4.0f, cos(currentFrame/5)*18);
-        atmosphereSize = 2.5f;
-        model = glm::translate(model, atmospherePos);
-        model = glm::scale(model, glm::vec3(atmosphereSize));
-        modelShader.setVec3("color", glm::vec3(0.78f, 0.5f, 0.06f));
-        modelShader.setMat4("model", model);
-        atmosphereModel.Draw(modelShader);
-
-        glDisable(GL_CULL_FACE);
-
-
-        // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
-
-
-        if (programState->ImGuiEnabled)
+        FrameData frameData;
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.viewPosition = glm::vec4(programState->camera.Position, 1.0f);
+        frameData.time = currentFrame;
+
+        bodies.Update(currentFrame);
+        {
+            PROFILE_SCOPE("lights");
+            lights.clear();
+            PointLightData sunLight;
+            sunLight.positionRange = glm::vec4(pointLight.position, ClusteredLighting::AttenuationRange(
+                    pointLight.constant, pointLight.linear, pointLight.quadratic));
+            sunLight.diffuseConstant = glm::vec4(pointLight.diffuse, pointLight.constant);
+            sunLight.specularLinear = glm::vec4(pointLight.specular, pointLight.linear);
+            sunLight.ambientQuadratic = glm::vec4(pointLight.ambient, pointLight.quadratic);
+            lights.push_back(sunLight);
+            // body lights have no ambient term and no attenuation besides the fade out at their range
+            for (size_t i = 0; i < bodies.Count(); i++)
+            {
+                if (bodies.lightRange[i] <= 0.0f)
+                    continue;
+                PointLightData light;
+                light.positionRange = glm::vec4(bodies.position[i], bodies.lightRange[i]);
+                light.diffuseConstant = glm::vec4(bodies.lightColor[i], 1.0f);
+                light.specularLinear = glm::vec4(bodies.lightColor[i], 0.0f);
+                light.ambientQuadratic = glm::vec4(0.0f);
+                lights.push_back(light);
+            }
+            lighting.Update(lights, view, glm::radians(programState->camera.Zoom), aspect, nearPlane, farPlane);
+            lighting.Fill(frameData, renderWidth, renderHeight);
+        }
+        frameUniforms.Update(frameData);
+        {
+            PROFILE_SCOPE("culling");
+            // models swap their placeholder for the real mesh while streaming, so their bounds are read every frame
+            for (size_t m = 0; m < models.size(); m++)
+                modelBounds[m] = models[m]->Bounds();
+            bodies.UpdateBounds(modelBounds);
+            bodies.Cull(Frustum::FromMatrix(projection * view));
+            float projectionScale = renderHeight / (2.0f * std::tan(glm::radians(programState->camera.Zoom) * 0.5f));
+            bodies.UpdateScreenScale(programState->camera.Position, projectionScale, nearPlane);
+        }
+
+        // collect the frame's draws, the queue orders them and drops redundant state changes
+        renderQueue.Clear();
+        glm::vec3 eye = programState->camera.Position;
+        // the sun and the skybox are left out until their programs are built
+        if (!lightShaderReady && lightShader.Ready()) {
+            lightModelUniform = lightShader.GetUniform("model");
+            lightNormalMatrixUniform = lightShader.GetUniform("normalMatrix");
+            lightShaderReady = true;
+        }
+        if (!skyboxShaderReady && skyboxShader.Ready()) {
+            GLStateCache::Instance().UseProgram(skyboxShader.ID);
+            skyboxShader.setInt("skybox", 0);
+            skyboxShaderReady = true;
+        }
+        // emissive bodies (the sun)
+        for (size_t i = 0; lightShaderReady && i < bodies.Count(); i++)
+        {
+            if (!bodies.emissive[i] || !bodies.bounds.visible[i])
+                continue;
+            float depth = glm::length(bodies.position[i] - eye) / farPlane;
+            renderQueue.Add(RenderQueue::MakeKey(RenderPass::Opaque, lightShader.ID, bodies.model[i], depth),
+                            RenderState::Opaque(), lightShader.ID, [&, i]() {
+                PROFILE_SCOPE("sun");
+                lightShader.setMat4(lightModelUniform, bodies.transform[i]);
+                lightShader.setMat3(lightNormalMatrixUniform, bodies.normalMatrix[i]);
+                models[bodies.model[i]]->Draw(lightShader, bodies.pixelsPerUnit[i], lodPixelError);
+            });
+        }
+
+        // bodies are drawn with one instanced call per shared mesh/material; the batch orders its draws itself and goes
+        // first among the opaque packets, it covers most of the screen
+        bodyBatch.Clear();
+        bodyBatch.maxPixelError = lodPixelError;
+        for (size_t i = 0; i < bodies.Count(); i++)
+        {
+            if (!bodies.emissive[i] && bodies.bounds.visible[i])
+                bodyBatch.Add(*models[bodies.model[i]], bodies.transform[i], bodies.normalMatrix[i], glm::vec4(1.0f),
+                              0.0f, bodies.pixelsPerUnit[i]);
+        }
+        // the batches pick the variant per material, these are the features of the whole pass
+        const unsigned int litFeatures = ShaderVariants::INSTANCED | (blinn ? ShaderVariants::BLINN : 0);
+        auto litSetup = [&lighting](Shader &shader) {
+            shader.setFloat("material.shininess", 16.0f);
+            lighting.Bind(shader);
+        };
+        if (Shader *litShader = litShaders.Best(litFeatures)) {
+            renderQueue.Add(RenderQueue::MakeKey(RenderPass::Opaque, litShader->ID, 0, 0.0f), RenderState::Opaque(),
+                            litShader->ID, [&]() {
+                PROFILE_SCOPE("planets");
+                bodyBatch.Draw(litShaders, litFeatures, litSetup);
+            });
+        }
+
+        // skybox behind everything opaque, before the transparent shells blend over it
+        if (skyboxShaderReady) {
+            renderQueue.Add(RenderQueue::MakeKey(RenderPass::Sky, skyboxShader.ID, 0, 1.0f), RenderState::Sky(),
+                            skyboxShader.ID, [&]() {
+                PROFILE_SCOPE("skybox");
+                GLStateCache &cache = GLStateCache::Instance();
+                cache.BindVertexArray(skyboxVAO);
+                cache.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            });
+        }
+
+        // atmospheres: one transparent packet per shell, so the queue's far-to-near key orders the shells whatever
+        // detail level each of them is drawn at
+        atmosphereOrder.clear();
+        for (size_t i = 0; i < bodies.Count(); i++)
+        {
+            if (bodies.atmosphereModel[i] >= 0 && bodies.atmosphereBounds.visible[i])
+                atmosphereOrder.push_back(i);
+        }
+        while (atmosphereBatches.size() < atmosphereOrder.size())
+            atmosphereBatches.emplace_back(new InstancedRenderer(&materials));
+        for (size_t shell = 0; shell < atmosphereOrder.size(); shell++)
+        {
+            size_t i = atmosphereOrder[shell];
+            InstancedRenderer &atmosphereBatch = *atmosphereBatches[shell];
+            atmosphereBatch.Clear();
+            atmosphereBatch.maxPixelError = lodPixelError;
+            atmosphereBatch.Add(*models[bodies.atmosphereModel[i]], bodies.atmosphereTransform[i],
+                                bodies.atmosphereNormalMatrix[i], bodies.atmosphereColor[i], 0.0f,
+                                bodies.atmospherePixelsPerUnit[i]);
+            Shader *atmosphereShader = litShaders.Best(litFeatures | ShaderVariants::ATMOSPHERE);
+            if (!atmosphereShader)
+                continue;
+            float depth = glm::length(bodies.position[i] - eye) / farPlane;
+            renderQueue.Add(RenderQueue::MakeKey(RenderPass::Transparent, atmosphereShader->ID, 0, depth),
+                            RenderState::Transparent(), atmosphereShader->ID, [&, shell]() {
+                PROFILE_SCOPE("atmospheres");
+                atmosphereBatches[shell]->Draw(litShaders, litFeatures | ShaderVariants::ATMOSPHERE, litSetup);
+            });
+        }
+
+        {
+            PROFILE_SCOPE("render queue");
+            renderQueue.Execute();
+        }
+
+
+        if (programState->ImGuiEnabled) {
+            PROFILE_SCOPE("imgui");
             DrawImGui(programState);
+        }
+        Profiler::Instance().EndFrame();
 
+        double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        if (gpuTimer)
+            gpuTimer->End();
+
+        // reads the offscreen target in headless runs, the back buffer otherwise
+        if (options.Capture(frame))
+            FrameCapture::SavePPM(FrameCapture::FileName(options.captureDirectory, frame), renderWidth, renderHeight);
 
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        if (!options.headless)
+            glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (options.Benchmarking() && frame >= options.warmupFrames)
+            frameStats.Add(cpuMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
     }
 
-    programState->SaveToFile("resources/program_state.txt");
+    if (gpuTimer) {
+        gpuTimer->Finish();
+        for (const auto &result : gpuTimer->Results()) {
+            if (result.first >= options.warmupFrames)
+                frameStats.AddGpu(result.second);
+        }
+        gpuTimer.reset();
+        std::vector<std::pair<std::string, std::string>> info = {
+                {"scene", SCENE_FILE},
+                {"camera_path", options.benchPath},
+                {"bodies", std::to_string(bodies.Count())},
+                {"lights", std::to_string(lights.size())},
+                {"resolution", std::to_string(options.width) + "x" + std::to_string(options.height)},
+                {"timestep", std::to_string(options.timeStep)},
+                {"headless", options.headless ? "true" : "false"},
+                {"vertex_format", options.compactVertices ? "compact" : "full"},
+                {"draw_submission", GLExtensions::MultiDrawElementsIndirect() ? "multi_draw_indirect" : "base_vertex"},
+                {"shader_compile", parallelCompile ? "parallel" : "serial"},
+                {"program_cache", ProgramCache::Available() ? "on" : "off"},
+                {"programs_cached", std::to_string(ProgramCache::Hits())},
+                {"programs_compiled", std::to_string(ProgramCache::Misses())},
+                {"renderer", (const char *) glGetString(GL_RENDERER)},
+                {"gl_version", (const char *) glGetString(GL_VERSION)}
+        };
+        if (frameStats.WriteJson(options.benchOutput, info))
+            std::cout << "benchmark results written to " << options.benchOutput << std::endl;
+    }
+
+    if (!options.tracePath.empty() && Trace::Instance().Write(options.tracePath))
+        std::cout << "trace written to " << options.tracePath << std::endl;
+
+    if (!options.Deterministic())
+        programState->SaveToFile("resources/program_state.txt");
+    offscreen.reset();
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -490,6 +740,95 @@ int main() {
     return 0;
 }
 
+void PrintUsage(const char *program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --headless          render into an offscreen framebuffer of an invisible window\n"
+              << "  --size WxH          framebuffer size (default " << SCR_WIDTH << "x" << SCR_HEIGHT << ")\n"
+              << "  --frames N          stop after N frames (headless default 1)\n"
+              << "  --timestep S        advance the simulation by S seconds per frame (headless default 1/60)\n"
+              << "  --capture LIST      dump frames as PPM: comma separated frame numbers or 'all'\n"
+              << "  --capture-dir DIR   directory for the dumps (default .)\n"
+              << "  --bench PATH        fly the camera path file and record frame times (timestep default 1/60)\n"
+              << "  --bench-output FILE JSON statistics of the benchmark (default bench.json)\n"
+              << "  --warmup N          frames rendered before the path starts and left out of the statistics (default 10)\n"
+              << "  --bodies N          add N synthetic bodies to the scene\n"
+              << "  --lights N          give N bodies a point light of random colour and range\n"
+              << "  --trace FILE        record startup and frames as a Chrome trace (chrome://tracing, Perfetto)\n"
+              << "  --vertex-format F   vertex buffer layout: compact (default) or full\n"
+              << "  --no-indirect       draw every batch separately even when glMultiDrawElementsIndirect is available\n"
+              << "  --no-program-cache  compile every shader from source instead of loading program binaries" << std::endl;
+}
+
+bool ParseOptions(int argc, char **argv, RunOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--headless") {
+            options.headless = true;
+            continue;
+        }
+        if (option == "--no-indirect") {
+            options.multiDrawIndirect = false;
+            continue;
+        }
+        if (option == "--no-program-cache") {
+            options.programCache = false;
+            continue;
+        }
+        // every other option takes a value
+        if (i + 1 >= argc)
+            return false;
+        std::istringstream value(argv[++i]);
+        char separator = 0;
+        if (option == "--size") {
+            if (!(value >> options.width >> separator >> options.height) || separator != 'x' || options.width <= 0 || options.height <= 0)
+                return false;
+        } else if (option == "--frames") {
+            if (!(value >> options.frames) || options.frames < 0)
+                return false;
+        } else if (option == "--timestep") {
+            if (!(value >> options.timeStep) || options.timeStep <= 0.0f)
+                return false;
+        } else if (option == "--capture") {
+            if (value.str() == "all") {
+                options.captureAll = true;
+                continue;
+            }
+            std::string number;
+            while (std::getline(value, number, ',')) {
+                std::istringstream frame(number);
+                int index = 0;
+                if (!(frame >> index) || index < 0)
+                    return false;
+                options.captureFrames.insert(index);
+            }
+        } else if (option == "--capture-dir") {
+            options.captureDirectory = value.str();
+        } else if (option == "--bench") {
+            options.benchPath = value.str();
+        } else if (option == "--bench-output") {
+            options.benchOutput = value.str();
+        } else if (option == "--warmup") {
+            if (!(value >> options.warmupFrames) || options.warmupFrames < 0)
+                return false;
+        } else if (option == "--trace") {
+            options.tracePath = value.str();
+        } else if (option == "--vertex-format") {
+            if (value.str() != "compact" && value.str() != "full")
+                return false;
+            options.compactVertices = value.str() == "compact";
+        } else if (option == "--lights") {
+            if (!(value >> options.syntheticLights) || options.syntheticLights < 0)
+                return false;
+        } else if (option == "--bodies") {
+            if (!(value >> options.syntheticBodies) || options.syntheticBodies < 0)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow *window) {
@@ -516,6 +855,8 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -543,6 +884,48 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     programState->camera.ProcessMouseScroll(yoffset);
 }
 
+// average CPU/GPU time of every profiled pass over the recent frames, with a graph of its history
+void DrawProfilerWindow() {
+    Profiler &profiler = Profiler::Instance();
+    ImGui::Begin("Profiler");
+    ImGui::Checkbox("Enabled", &profiler.enabled);
+    const std::deque<Profiler::Frame> &history = profiler.History();
+    for (size_t name = 0; name < profiler.Names().size(); name++) {
+        // one value per frame, 0 where the pass didn't run
+        std::vector<float> cpu(history.size(), 0.0f), gpu(history.size(), 0.0f);
+        for (size_t frame = 0; frame < history.size(); frame++) {
+            for (const Profiler::Sample &sample : history[frame].samples) {
+                if (sample.name != (int) name)
+                    continue;
+                cpu[frame] += (float) (sample.cpuEnd - sample.cpuStart);
+                if (sample.gpuStart >= 0.0)
+                    gpu[frame] += (float) (sample.gpuEnd - sample.gpuStart);
+            }
+        }
+        float cpuAverage = 0.0f, gpuAverage = 0.0f;
+        for (size_t frame = 0; frame < history.size(); frame++) {
+            cpuAverage += cpu[frame];
+            gpuAverage += gpu[frame];
+        }
+        if (!history.empty()) {
+            cpuAverage /= history.size();
+            gpuAverage /= history.size();
+        }
+        const std::string &label = profiler.Names()[name];
+        ImGui::Text("%-12s cpu %6.3f ms  gpu %6.3f ms", label.c_str(), cpuAverage, gpuAverage);
+        if (!gpu.empty())
+            ImGui::PlotLines(("##" + label).c_str(), &gpu[0], (int) gpu.size(), 0, "gpu ms", 0.0f, FLT_MAX, ImVec2(0, 40));
+    }
+    GLStateCache &stateCache = GLStateCache::Instance();
+    ImGui::Text("state changes %u issued, %u skipped", stateCache.Issued(), stateCache.Skipped());
+    if (ImGui::Button("Export CSV"))
+        profiler.ExportCsv("profile.csv");
+    ImGui::SameLine();
+    if (ImGui::Button("Export Chrome trace"))
+        profiler.ExportChromeTrace("profile_trace.json");
+    ImGui::End();
+}
+
 void DrawImGui(ProgramState *programState) {
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
@@ -556,9 +939,12 @@ void DrawImGui(ProgramState *programState) {
         ImGui::Text("Camera front: (%f, %f, %f)", c.Front.x, c.Front.y, c.Front.z);
         ImGui::Checkbox("Camera mouse update", &programState->CameraMouseMovementUpdateEnabled);
         ImGui::Checkbox("Blinn-Phong lighting", &blinn);
+        ImGui::DragFloat("LOD pixel error", &lodPixelError, 0.05f, 0.0f, 16.0f);
         ImGui::End();
     }
 
+    DrawProfilerWindow();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -585,33 +971,11 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 }
 
 
+// faces are decoded in parallel by the texture loader; the returned cubemap is complete once
+// TextureLoader::IsUploaded reports it (after Finish, or after enough streamed frames)
 // -------------------------------------------------------
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    TRACE_SCOPE("loadCubemap");
+    return TextureLoader::Instance().LoadCubemap(faces);
 }